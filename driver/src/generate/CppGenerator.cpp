@@ -4,6 +4,7 @@
 #include "src/generate/CppGenerator.hpp"
 
 #include "src/generate/CppClassGenerator.hpp"
+#include "src/visitor/Gatherer.hpp"
 #include "src/primitive/encode.hpp"
 
 birch::CppGenerator::CppGenerator(std::ostream& base, const int level,
@@ -574,14 +575,14 @@ void birch::CppGenerator::visit(const Assume* o) {
   if (*o->name == "<-?") {
     line("libbirch::optional_assign(" << o->left << ", " << o->right << ");");
   } else if (*o->name == "<~") {
-    start("libbirch::simulate(" << o->left << ", birch::SimulateEvent(");
-    finish('(' << o->right << ")->distribution(), handler_), handler_);");
+    start("libbirch::simulate<birch::type::SimulateEvent,birch::type::PlayHandler>(" << o->left);
+    finish(", (" << o->right << ")->distribution(), handler_);");
   } else if (*o->name == "~>") {
-    start("libbirch::observe(birch::ObserveEvent(" << o->left << ", ");
-    finish('(' << o->right << ")->distribution(), handler_), handler_);");
+    start("libbirch::observe<birch::type::ObserveEvent,birch::type::PlayHandler>(" << o->left);
+    finish(", (" << o->right << ")->distribution(), handler_);");
   } else if (*o->name == "~") {
-    start("libbirch::assume(birch::AssumeEvent(" << o->left << ", ");
-    finish('(' << o->right << ")->distribution(), handler_), handler_);");
+    start("libbirch::assume<birch::type::AssumeEvent,birch::type::PlayHandler>(" << o->left);
+    finish(", (" << o->right << ")->distribution(), handler_);");
   } else {
     assert(false);
   }
@@ -616,17 +617,23 @@ void birch::CppGenerator::visit(const If* o) {
 void birch::CppGenerator::visit(const For* o) {
   auto index = getIndex(o->index);
   genTraceLine(o->loc);
+  auto exclusive = genExclusive(o->braces);
   start("for (auto " << index << " = " << o->from << "; ");
   finish(index << " <= " << o->to << "; ++" << index << ") {");
   in();
   *this << o->braces->strip();
   out();
   line("}");
+  if (exclusive) {
+    out();
+    line("}");
+  }
 }
 
 void birch::CppGenerator::visit(const Parallel* o) {
   auto index = getIndex(o->index);
   genTraceLine(o->loc);
+  auto exclusive = genExclusive(o->braces);
   line("#pragma omp parallel");
   line("{");
   in();
@@ -646,6 +653,10 @@ void birch::CppGenerator::visit(const Parallel* o) {
   line("}");
   out();
   line("}");
+  if (exclusive) {
+    out();
+    line("}");
+  }
 }
 
 void birch::CppGenerator::visit(const While* o) {
@@ -759,6 +770,43 @@ void birch::CppGenerator::visit(const TypeList* o) {
   middle(o->head << ", " << o->tail);
 }
 
+bool birch::CppGenerator::genExclusive(const Statement* o) {
+  /* local variables declared in the body are excluded, as they do not
+   * outlive an iteration */
+  Gatherer<LocalVariable> declared;
+  o->accept(&declared);
+  std::set<int> excluded;
+  for (auto local : declared) {
+    excluded.insert(local->number);
+  }
+
+  /* local array variables with elements assigned in the body */
+  Gatherer<Assign> assigns([](const Assign* o) {
+        return o->left->isSlice();
+      });
+  o->accept(&assigns);
+  std::vector<const NamedExpression*> arrays;
+  for (auto assign : assigns) {
+    auto slice = dynamic_cast<const Slice*>(assign->left);
+    assert(slice);
+    auto named = dynamic_cast<const NamedExpression*>(slice->single->strip());
+    if (named && named->isLocal() && named->type->isArray() &&
+        excluded.insert(named->number).second) {
+      arrays.push_back(named);
+    }
+  }
+
+  if (!arrays.empty()) {
+    line("{");
+    in();
+    for (auto named : arrays) {
+      start("libbirch::Exclusive<decltype(" << named << ")> ");
+      finish("exclusive_" << named->number << "_(" << named << ");");
+    }
+  }
+  return !arrays.empty();
+}
+
 std::string birch::CppGenerator::getIndex(const Statement* o) {
   auto index = dynamic_cast<const LocalVariable*>(o);
   assert(index);
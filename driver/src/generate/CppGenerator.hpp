@@ -114,6 +114,19 @@ protected:
   template<class T>
   void genInit(const T* o);
 
+  /**
+   * Generate the opening of a scope that pins exclusive, for the duration of
+   * a loop, each local array variable that has elements assigned in the
+   * body of the loop, so that these assignments need not check whether the
+   * buffer of the array is shared.
+   *
+   * @param o Body of the loop.
+   *
+   * @return Was a scope opened? If so, the caller must close it after the
+   * loop.
+   */
+  bool genExclusive(const Statement* o);
+
   /**
    * Generate the name of a loop index.
    */
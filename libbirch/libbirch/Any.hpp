@@ -12,6 +12,7 @@
 
 namespace libbirch {
 class Label;
+template<class T> class Transient;
 
 /**
  * Base class providing reference counting, cycle breaking, and lazy deep
@@ -25,6 +26,7 @@ class Label;
  * correctly with multiple inheritance, Any must be the *first* base class.
  */
 class Any {
+  template<class T> friend class Transient;
 public:
   using class_type_ = Any;
   using this_type_ = Any;
@@ -93,10 +95,14 @@ public:
 
   /**
    * Finish the object.
+   *
+   * As for freeze(), mark(), scan(), reach() and collect(), the visit to
+   * member variables is deferred with defer_visit() rather than made
+   * recursively.
    */
   void finish(Label* label) {
     if (!(flags.exchangeOr(FINISHED) & FINISHED)) {
-      finish_(label);
+      defer_visit(this, VISIT_FINISH, label);
     }
   }
 
@@ -112,7 +118,7 @@ public:
         //   that are not frozen
         flags.maskOr(FROZEN_UNIQUE);
       }
-      freeze_();
+      defer_visit(this, VISIT_FREEZE);
     }
   }
 
@@ -162,8 +168,7 @@ public:
   void mark() {
     if (!(flags.exchangeOr(MARKED) & MARKED)) {
       flags.maskAnd(~(POSSIBLE_ROOT|BUFFERED|SCANNED|REACHED|COLLECTED));
-      label.mark();
-      mark_();
+      defer_visit(this, VISIT_MARK);
     }
   }
 
@@ -178,12 +183,10 @@ public:
       flags.maskAnd(~MARKED);  // unset for next time
       if (numShared() > 0u) {
         if (!(flags.exchangeOr(REACHED) & REACHED)) {
-          label.reach();
-          reach_();
+          defer_visit(this, VISIT_REACH);
         }
       } else {
-        label.scan();
-        scan_();
+        defer_visit(this, VISIT_SCAN);
       }
     }
   }
@@ -199,8 +202,7 @@ public:
       flags.maskAnd(~MARKED);  // unset for next time
     }
     if (!(flags.exchangeOr(REACHED) & REACHED)) {
-      label.reach();
-      reach_();
+      defer_visit(this, VISIT_REACH);
     }
   }
 
@@ -214,8 +216,40 @@ public:
     auto old = flags.exchangeOr(COLLECTED);
     if (!(old & COLLECTED) && !(old & REACHED)) {
       register_unreachable(this);
-      label.collect();
+      defer_visit(this, VISIT_COLLECT);
+    }
+  }
+
+  /**
+   * Make a visit to the object previously deferred with defer_visit().
+   *
+   * @param op The operation.
+   * @param label The label, for a finish operation.
+   */
+  void visit(const int op, Label* label) {
+    switch (op) {
+    case VISIT_FINISH:
+      finish_(label);
+      break;
+    case VISIT_FREEZE:
+      freeze_();
+      break;
+    case VISIT_MARK:
+      this->label.mark();
+      mark_();
+      break;
+    case VISIT_SCAN:
+      this->label.scan();
+      scan_();
+      break;
+    case VISIT_REACH:
+      this->label.reach();
+      reach_();
+      break;
+    case VISIT_COLLECT:
+      this->label.collect();
       collect_();
+      break;
     }
   }
 
@@ -226,6 +260,11 @@ public:
     assert(sharedCount.load() == 0u);
     this->flags.maskOr(DESTROYED);
     this->size = size_();
+    #ifdef ENABLE_MEMORY_STATS
+    if (flags.load() & COUNTED) {
+      stats_destroy(this);
+    }
+    #endif
     this->~Any();
   }
 
@@ -246,6 +285,11 @@ public:
     //   a performance issue, and as long as one thread can reach the object
     //   it is fine to be off
     // ^ disabling this option improves performance on several examples
+    #ifdef ENABLE_MEMORY_STATS
+    if (!(flags.exchangeOr(COUNTED) & COUNTED)) {
+      stats_create(this);
+    }
+    #endif
     sharedCount.increment();
   }
 
@@ -430,10 +474,15 @@ private:
    *   - *marked*,
    *   - *scanned*,
    *   - *reached*,
-   *   - *collected*---
+   *   - *collected*,
+   *   - *destroyed*---
    *
    * ---these used for cycle collection as in @ref Bacon2001
-   * "Bacon & Rajan (2001)".
+   * "Bacon & Rajan (2001)"---then
+   *
+   *   - *counted*---
+   *
+   * ---used for memory statistics, when enabled.
    *
    * The second group of flags take the place of the colors described in
    * @ref Bacon2001 "Bacon & Rajan (2001)". The reason is to ensure that both
@@ -472,7 +521,8 @@ private:
     SCANNED = (1u << 6u),
     REACHED = (1u << 7u),
     COLLECTED = (1u << 8u),
-    DESTROYED = (1u << 9u)
+    DESTROYED = (1u << 9u),
+    COUNTED = (1u << 10u)
   };
 
 public:
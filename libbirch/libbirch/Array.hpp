@@ -28,6 +28,7 @@ public:
   using shape_type = F;
   using eigen_type = typename eigen_type<this_type>::type;
   using eigen_stride_type = typename eigen_stride_type<this_type>::type;
+  using eigen_aligned_type = typename eigen_aligned_type<this_type>::type;
 
   /**
    * Constructor.
@@ -36,7 +37,8 @@ public:
       shape(),
       buffer(nullptr),
       offset(0),
-      isView(false) {
+      isView(false),
+      nexclusive(0) {
     assert(shape.volume() == 0);
   }
 
@@ -50,7 +52,8 @@ public:
       shape(shape),
       buffer(nullptr),
       offset(0),
-      isView(false) {
+      isView(false),
+      nexclusive(0) {
     allocate();
   }
 
@@ -64,7 +67,8 @@ public:
       shape(shape),
       buffer(nullptr),
       offset(0),
-      isView(false) {
+      isView(false),
+      nexclusive(0) {
     allocate();
     initialize();
   }
@@ -82,7 +86,8 @@ public:
       shape(shape),
       buffer(nullptr),
       offset(0),
-      isView(false) {
+      isView(false),
+      nexclusive(0) {
     allocate();
     initialize(args...);
   }
@@ -98,7 +103,8 @@ public:
       shape(values.size()),
       buffer(nullptr),
       offset(0),
-      isView(false) {
+      isView(false),
+      nexclusive(0) {
     allocate();
     std::uninitialized_copy(values.begin(), values.end(), begin());
   }
@@ -114,7 +120,8 @@ public:
       shape(values.size(), values.begin()->size()),
       buffer(nullptr),
       offset(0),
-      isView(false) {
+      isView(false),
+      nexclusive(0) {
     allocate();
     auto ptr = buf();
     for (auto row : values) {
@@ -135,7 +142,8 @@ public:
       shape(shape),
       buffer(nullptr),
       offset(0),
-      isView(false) {
+      isView(false),
+      nexclusive(0) {
     allocate();
     int64_t n = 0;
     for (auto iter = begin(); iter != end(); ++iter) {
@@ -150,10 +158,13 @@ public:
       shape(o.shape),
       buffer(o.buffer),
       offset(o.offset),
-      isView(false) {
+      isView(false),
+      nexclusive(0) {
     if (o.buffer) {
-      if (!o.isView && is_value<T>::value) {
-        /* copy on write for non-views of value types */
+      if (!o.isView && is_value<T>::value && o.nexclusive == 0u) {
+        /* copy on write for non-views of value types, unless the other
+         * array is pinned exclusive, as it may be written without checking
+         * whether its buffer is shared */
         buffer->incUsage();
       } else {
         /* immediate copy for others */
@@ -174,7 +185,8 @@ public:
       shape(o.shape.compact()),
       buffer(nullptr),
       offset(0),
-      isView(false) {
+      isView(false),
+      nexclusive(0) {
     allocate();
     uninitialized_copy(o);
   }
@@ -192,6 +204,7 @@ public:
   void bitwiseFix() {
     assert(!isView);
     bufferLock.bitwiseFix();
+    nexclusive = 0u;
     if (buffer) {
       if (is_value<T>::value) {
         buffer->incUsage();
@@ -199,7 +212,7 @@ public:
         auto bytes = Buffer<T>::size(volume());
         assert(bytes > 0u);
 	      void* src = buf();
-        buffer = new (libbirch::allocate(bytes)) Buffer<T>();
+        buffer = new (libbirch::allocate(bytes)) Buffer<T>(volume());
         offset = 0;
         void* dst = buf();
         std::memcpy(dst, src, sizeof(T)*volume());
@@ -238,7 +251,7 @@ public:
       copy(o);
     } else {
       lock();
-      if (o.isView) {
+      if (o.isView || nexclusive > 0u) {
         Array<T,F> tmp(o.shape, o);
         swap(tmp);
       } else {
@@ -279,20 +292,31 @@ public:
    */
   template<class V, class U, std::enable_if_t<V::rangeCount() != 0,int> = 0>
   auto set(const V& slice, const U& value) {
-    pinWrite();
-    Array<T,decltype(shape(slice))> o(shape(slice), buffer, offset +
-        shape.serial(slice));
-    o = value;
-    unpin();
-    return o;
+    if (nexclusive > 0u) {
+      Array<T,decltype(shape(slice))> o(shape(slice), buffer, offset +
+          shape.serial(slice));
+      o = value;
+      return o;
+    } else {
+      pinWrite();
+      Array<T,decltype(shape(slice))> o(shape(slice), buffer, offset +
+          shape.serial(slice));
+      o = value;
+      unpin();
+      return o;
+    }
   }
 
   template<class V, class U, std::enable_if_t<V::rangeCount() == 0,int> = 0>
   T& set(const V& slice, const U& value) {
-    pinWrite();
-    auto& o = (*(buf() + shape.serial(slice)) = value);
-    unpin();
-    return o;
+    if (nexclusive > 0u) {
+      return *(buf() + shape.serial(slice)) = value;
+    } else {
+      pinWrite();
+      auto& o = (*(buf() + shape.serial(slice)) = value);
+      unpin();
+      return o;
+    }
   }
 
   template<class V, std::enable_if_t<V::rangeCount() != 0,int> = 0>
@@ -416,6 +440,40 @@ public:
     const_cast<Array*>(this)->bufferLock.unsetRead();
   }
 
+  /**
+   * Pin the buffer exclusive. This ensures that the buffer is not shared,
+   * as pinWrite(), and furthermore keeps it so until unpinned with
+   * unpinExclusive(): while pinned exclusive, copies of the array do not
+   * share the buffer, but copy it immediately. Element writes with set()
+   * then need not pin the buffer, and reduce to plain stores.
+   *
+   * This is intended for loops that write many elements, such that the
+   * check for sharing is made once before the loop, rather than for each
+   * element. The caller must ensure that no other thread pins or resizes
+   * the array meanwhile, but concurrent reads and writes of distinct
+   * elements, such as in a parallel loop, are fine. Exclusive pins may be
+   * nested, and have no effect on views.
+   */
+  void pinExclusive() {
+    if (!isView) {
+      if (nexclusive == 0u) {
+        pinWrite();
+        unpin();
+      }
+      ++nexclusive;
+    }
+  }
+
+  /**
+   * Unpin the buffer exclusive.
+   */
+  void unpinExclusive() {
+    if (!isView) {
+      assert(nexclusive > 0u);
+      --nexclusive;
+    }
+  }
+
   /**
    * Lock the buffer. This is used before substitution of the buffer by a
    * copy-on-write operation.
@@ -453,13 +511,23 @@ public:
     if (!buffer || isShared()) {
       Array<T,F> tmp(s, *this);
       swap(tmp);
+      std::memmove((void*)(buf() + i + 1), (void*)(buf() + i), (n - i)*sizeof(T));
+    } else if (i == 0 && offset > 0) {
+      /* room at the front, left by erasing from the front */
+      --offset;
     } else {
-      auto oldBytes = Buffer<T>::size(shape.volume());
-      auto newBytes = Buffer<T>::size(s.volume());
-      buffer = (Buffer<T>*)libbirch::reallocate(buffer, oldBytes,
-          buffer->tid, newBytes);
+      auto cap = buffer->capacity();
+      if (offset + n == cap) {
+        /* full; if at least a third of the buffer is free at the front,
+         * move the elements back to the start, otherwise grow */
+        if (2*offset < n) {
+          cap = capacity(n + n/2 + 1);
+        }
+        buffer = Buffer<T>::reallocate(buffer, offset, n, cap);
+        offset = 0;
+      }
+      std::memmove((void*)(buf() + i + 1), (void*)(buf() + i), (n - i)*sizeof(T));
     }
-    std::memmove((void*)(buf() + i + 1), (void*)(buf() + i), (n - i)*sizeof(T));
     new (buf() + i) T(x);
     shape = s;
     unlock();
@@ -491,11 +559,18 @@ public:
       for (int j = i; j < i + len; ++j) {
         buf()[j].~T();
       }
-      std::memmove((void*)(buf() + i), (void*)(buf() + i + len), (n - len - i)*sizeof(T));
-      auto oldBytes = Buffer<T>::size(shape.volume());
-      auto newBytes = Buffer<T>::size(s.volume());
-      buffer = (Buffer<T>*)libbirch::reallocate(buffer, oldBytes,
-          buffer->tid, newBytes);
+      if (i == 0) {
+        /* leave room at the front rather than moving the elements */
+        offset += len;
+      } else {
+        std::memmove((void*)(buf() + i), (void*)(buf() + i + len), (n - len - i)*sizeof(T));
+      }
+      auto m = s.size();
+      if (2*m < buffer->capacity()) {
+        /* less than half in use, shrink */
+        buffer = Buffer<T>::reallocate(buffer, offset, m, capacity(m));
+        offset = 0;
+      }
     }
     shape = s;
     unlock();
@@ -523,6 +598,30 @@ public:
         colStride()));
   }
 
+  /**
+   * Are the elements stored contiguously, with the first aligned to
+   * Buffer::ALIGNMENT? If so, toEigenAligned() may be used in place of
+   * toEigen(), and allows Eigen to vectorize with aligned loads. This is
+   * typically the case for arrays that are not views, of at least
+   * Buffer::ALIGNMENT bytes.
+   */
+  bool isAligned() const {
+    return buffer && shape.size() == shape.volume() && colStride() == 1 &&
+        reinterpret_cast<uintptr_t>(buf()) % Buffer<T>::ALIGNMENT == 0u;
+  }
+
+  template<IS_VALUE(T)>
+  auto toEigenAligned() {
+    assert(isAligned());
+    return eigen_aligned_type(buf(), rows(), cols());
+  }
+
+  template<IS_VALUE(T)>
+  auto toEigenAligned() const {
+    assert(isAligned());
+    return eigen_aligned_type(buf(), rows(), cols());
+  }
+
   /**
    * Construct from Eigen Matrix expression.
    */
@@ -531,7 +630,8 @@ public:
       shape(o.rows(), o.cols()),
       buffer(nullptr),
       offset(0),
-      isView(false) {
+      isView(false),
+      nexclusive(0) {
     allocate();
     toEigen() = o;
   }
@@ -544,7 +644,8 @@ public:
       shape(o.rows(), o.cols()),
       buffer(nullptr),
       offset(0),
-      isView(false) {
+      isView(false),
+      nexclusive(0) {
     allocate();
     toEigen() = o;
   }
@@ -557,7 +658,8 @@ public:
       shape(o.rows(), o.cols()),
       buffer(nullptr),
       offset(0),
-      isView(false) {
+      isView(false),
+      nexclusive(0) {
     allocate();
     toEigen() = o;
   }
@@ -604,7 +706,8 @@ private:
       shape(shape.compact()),
       buffer(nullptr),
       offset(0),
-      isView(false) {
+      isView(false),
+      nexclusive(0) {
     allocate();
     uninitialized_copy(o);
   }
@@ -616,15 +719,16 @@ private:
       shape(shape),
       buffer(buffer),
       offset(offset),
-      isView(true) {
+      isView(true),
+      nexclusive(0) {
     //
   }
 
   /**
-   * Raw pointer to underlying buffer.
+   * Raw pointer to underlying buffer, null if there is none.
    */
   T* buf() const {
-    return buffer->buf() + offset;
+    return buffer ? buffer->buf() + offset : nullptr;
   }
 
   /**
@@ -645,6 +749,15 @@ private:
     std::swap(offset, o.offset);
   }
 
+  /**
+   * Compute the capacity with which to reallocate the buffer of a
+   * one-dimensional array for at least @p n elements. This fills the space
+   * that the allocator would reserve anyway.
+   */
+  static int64_t capacity(const int64_t n) {
+    return Buffer<T>::count(round_allocation(Buffer<T>::size(n)));
+  }
+
   /**
    * Allocate memory for array, leaving uninitialized.
    */
@@ -652,7 +765,7 @@ private:
     assert(!buffer);
     auto bytes = Buffer<T>::size(volume());
     if (bytes > 0u) {
-      buffer = new (libbirch::allocate(bytes)) Buffer<T>();
+      buffer = new (libbirch::allocate(bytes)) Buffer<T>(volume());
       offset = 0;
     }
   }
@@ -670,7 +783,7 @@ private:
           iter->~T();
         }
       }
-      size_t bytes = Buffer<T>::size(volume());
+      size_t bytes = Buffer<T>::size(buffer->capacity());
       libbirch::deallocate(buffer, bytes, buffer->tid);
     }
     buffer = nullptr;
@@ -744,6 +857,11 @@ private:
    */
   bool isView;
 
+  /**
+   * Number of exclusive pins on the buffer.
+   */
+  uint16_t nexclusive;
+
   /**
    * Lock used for copy-on-write. Read use is obtained when the current
    * buffer must be preserved for either read or write operations. Write use
@@ -762,6 +880,44 @@ struct is_acyclic<Array<T,F>,N> {
   static const bool value = is_acyclic<T,N>::value;
 };
 
+/**
+ * Exclusive pin of an array for the duration of a scope.
+ *
+ * @ingroup libbirch
+ *
+ * @tparam A Array type.
+ *
+ * @seealso Array::pinExclusive()
+ */
+template<class A>
+class Exclusive {
+public:
+  /**
+   * Constructor.
+   *
+   * @param a The array to pin exclusive.
+   */
+  Exclusive(A& a) : a(a) {
+    a.pinExclusive();
+  }
+
+  Exclusive(const Exclusive&) = delete;
+  Exclusive& operator=(const Exclusive&) = delete;
+
+  /**
+   * Destructor.
+   */
+  ~Exclusive() {
+    a.unpinExclusive();
+  }
+
+private:
+  /**
+   * The array.
+   */
+  A& a;
+};
+
 /**
  * Default array for `D` dimensions.
  */
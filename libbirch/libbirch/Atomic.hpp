@@ -111,6 +111,28 @@ public:
     return old;
   }
 
+  /**
+   * Compare the value with an expected value and, if equal, replace it with
+   * a desired value, atomically.
+   *
+   * @param expected Expected value. If the comparison fails, this is
+   * updated to the current value.
+   * @param desired Desired value.
+   *
+   * @return True if the value was replaced, false otherwise.
+   *
+   * OpenMP atomics do not support compare-and-swap, so the OpenMP
+   * implementation uses the equivalent compiler builtin.
+   */
+  bool compareExchange(T& expected, const T& desired) {
+    #if LIBBIRCH_ATOMIC_OPENMP
+    return __atomic_compare_exchange_n(&this->value, &expected, desired,
+        true, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    #else
+    return this->value.compare_exchange_weak(expected, desired);
+    #endif
+  }
+
   /**
    * Apply a mask, with bitwise `and`, and return the previous value,
    * atomically.
@@ -6,6 +6,7 @@
 #include "libbirch/external.hpp"
 #include "libbirch/thread.hpp"
 #include "libbirch/Atomic.hpp"
+#include "libbirch/memory.hpp"
 
 namespace libbirch {
 /**
@@ -16,19 +17,37 @@ namespace libbirch {
  * counting semantics are simpler.
  *
  * @ingroup libbirch
+ *
+ * A buffer has a capacity, the number of elements for which it is
+ * allocated, which may exceed the number in use, so that one-dimensional
+ * arrays can grow and shrink without reallocating each time.
+ *
+ * The contents of buffers with a capacity of at least ALIGNMENT bytes start
+ * at an address that is a multiple of ALIGNMENT, a cache line, so that they
+ * can be loaded with aligned vector instructions; the allocation is padded
+ * to allow for this. The contents of smaller buffers start immediately
+ * after the bookkeeping variables, at a multiple of 16 bytes, so as not to
+ * waste space on the many small arrays of a typical program.
  */
 template<class T>
-class Buffer {
+class alignas(16) Buffer {
 public:
   Buffer(const Buffer& o) = delete;
   Buffer(Buffer&& o) = delete;
   Buffer& operator=(const Buffer&) = delete;
   Buffer& operator=(Buffer&&) = delete;
 
+  /**
+   * Alignment of the contents of large buffers, in bytes.
+   */
+  static constexpr size_t ALIGNMENT = 64u;
+
   /**
    * Constructor.
+   *
+   * @param n Capacity.
    */
-  Buffer();
+  Buffer(const int64_t n);
 
   /**
    * Increment the usage count.
@@ -47,6 +66,11 @@ public:
    */
   unsigned numUsage() const;
 
+  /**
+   * Capacity.
+   */
+  int64_t capacity() const;
+
   /**
    * Get the start of the buffer.
    */
@@ -57,12 +81,32 @@ public:
    */
   const T* buf() const;
 
+  /**
+   * Reallocate a buffer to a new capacity. The buffer must not be shared.
+   *
+   * @param buffer The buffer.
+   * @param offset Offset of the first element in use.
+   * @param m Number of elements in use.
+   * @param n New capacity, at least @p m.
+   *
+   * @return The reallocated buffer, with the elements in use moved to its
+   * start.
+   */
+  static Buffer<T>* reallocate(Buffer<T>* buffer, const int64_t offset,
+      const int64_t m, const int64_t n);
+
   /**
    * Compute the number of bytes that should be allocated for a buffer of
-   * this type with @p n elements.
+   * this type with capacity @p n.
    */
   static size_t size(const int64_t n);
 
+  /**
+   * Compute the capacity of a buffer of this type allocated with @p bytes
+   * bytes. This is the inverse of size().
+   */
+  static int64_t count(const size_t bytes);
+
   /**
    * Id of the thread that allocated the buffer.
    */
@@ -75,17 +119,17 @@ private:
   Atomic<unsigned> useCount;
 
   /**
-   * First element in the buffer. Taking the address of this gives a pointer
-   * to the start of the overallocated buffer.
+   * Capacity.
    */
-  alignas(T) char first;
+  int64_t n;
 };
 }
 
 template<class T>
-libbirch::Buffer<T>::Buffer() :
+libbirch::Buffer<T>::Buffer(const int64_t n) :
     tid(get_thread_num()),
-    useCount(1) {
+    useCount(1),
+    n(n) {
   //
 }
 
@@ -105,17 +149,75 @@ unsigned libbirch::Buffer<T>::numUsage() const {
   return useCount.load();
 }
 
+template<class T>
+int64_t libbirch::Buffer<T>::capacity() const {
+  return n;
+}
+
 template<class T>
 T* libbirch::Buffer<T>::buf() {
-  return (T*)&first;
+  return const_cast<T*>(static_cast<const Buffer<T>*>(this)->buf());
 }
 
 template<class T>
 const T* libbirch::Buffer<T>::buf() const {
-  return (const T*)&first;
+  auto first = reinterpret_cast<uintptr_t>(this + 1);
+  if (sizeof(T)*n >= ALIGNMENT) {
+    first = (first + ALIGNMENT - 1u) & ~uintptr_t(ALIGNMENT - 1u);
+  }
+  return reinterpret_cast<const T*>(first);
+}
+
+template<class T>
+libbirch::Buffer<T>* libbirch::Buffer<T>::reallocate(Buffer<T>* buffer,
+    const int64_t offset, const int64_t m, const int64_t n) {
+  assert(buffer->numUsage() == 1u);
+  assert(offset + m <= buffer->n);
+  assert(m <= n);
+
+  /* move the elements in use to immediately after the bookkeeping
+   * variables, where they survive reallocation to a smaller size, then
+   * after reallocation to their proper start, which depends on the new
+   * address and capacity */
+  auto oldBytes = size(buffer->n);
+  auto newBytes = size(n);
+  auto packed = reinterpret_cast<T*>(buffer + 1);
+  std::memmove((void*)packed, (void*)(buffer->buf() + offset), m*sizeof(T));
+  auto ptr = libbirch::reallocate(buffer, oldBytes, buffer->tid, newBytes);
+  if (ptr != buffer) {
+    /* the allocation has moved to the current thread */
+    buffer = static_cast<Buffer<T>*>(ptr);
+    buffer->tid = get_thread_num();
+  }
+  buffer->n = n;
+  packed = reinterpret_cast<T*>(buffer + 1);
+  std::memmove((void*)buffer->buf(), (void*)packed, m*sizeof(T));
+  return buffer;
 }
 
 template<class T>
 size_t libbirch::Buffer<T>::size(const int64_t n) {
-  return n > 0 ? sizeof(T)*n + sizeof(Buffer<T>) : 0;
+  if (n > 0) {
+    auto bytes = sizeof(T)*n + sizeof(Buffer<T>);
+    if (sizeof(T)*n >= ALIGNMENT) {
+      /* allocations are aligned to at least 16 bytes, so padding of at most
+       * this much aligns the contents */
+      bytes += ALIGNMENT - 16u;
+    }
+    return bytes;
+  } else {
+    return 0;
+  }
+}
+
+template<class T>
+int64_t libbirch::Buffer<T>::count(const size_t bytes) {
+  assert(bytes >= sizeof(Buffer<T>));
+  auto n = int64_t((bytes - sizeof(Buffer<T>))/sizeof(T));
+  if (sizeof(T)*n >= ALIGNMENT) {
+    /* with padding, or else as many as fit without */
+    n = std::max(int64_t((bytes - sizeof(Buffer<T>) - (ALIGNMENT - 16u))/
+        sizeof(T)), int64_t((ALIGNMENT - 1u)/sizeof(T)));
+  }
+  return n;
 }
@@ -0,0 +1,156 @@
+/**
+ * @file
+ */
+#pragma once
+
+#include "libbirch/external.hpp"
+
+namespace libbirch {
+/**
+ * Chunk of memory from which allocations of a single size are made.
+ *
+ * @ingroup libbirch
+ *
+ * A chunk is a region of Chunk::size bytes, aligned to that size, and
+ * reserved from the operating system with `mmap`. This header is placed at
+ * its start, and the remainder is divided into blocks of a single size.
+ * Blocks are handed out first from a free list of blocks that have been
+ * returned to the chunk, then by bumping a pointer into the untouched
+ * remainder of the chunk. Because chunks are aligned to their size, the
+ * chunk to which a block belongs is found by masking the low bits of its
+ * address.
+ *
+ * A chunk is owned by a single thread, and all operations on it must be
+ * performed by that thread.
+ */
+class alignas(64) Chunk {
+public:
+  /**
+   * Size of a chunk, in bytes.
+   */
+  static constexpr size_t size = 2ull << 20ull;
+
+  /**
+   * Initialize the chunk for blocks of a given size.
+   *
+   * @param bin Size class of blocks.
+   * @param blockSize Size of blocks, in bytes.
+   * @param tid Id of the owning thread.
+   */
+  void init(const int bin, const size_t blockSize, const int tid) {
+    this->next = nullptr;
+    this->prev = nullptr;
+    this->free = nullptr;
+    this->bump = reinterpret_cast<char*>(this) + sizeof(Chunk);
+    this->end = reinterpret_cast<char*>(this) + size;
+    this->blockSize = blockSize;
+    this->nlive = 0u;
+    this->bin = bin;
+    this->tid = tid;
+    this->partial = false;
+  }
+
+  /**
+   * Get the chunk to which a block belongs.
+   */
+  static Chunk* of(void* block) {
+    return reinterpret_cast<Chunk*>(reinterpret_cast<uintptr_t>(block) &
+        ~(uintptr_t(size) - 1u));
+  }
+
+  /**
+   * Are there no blocks in use?
+   */
+  bool empty() const {
+    return nlive == 0u;
+  }
+
+  /**
+   * Are all blocks in use?
+   */
+  bool full() const {
+    return !free && bump + blockSize > end;
+  }
+
+  /**
+   * Take a block from the chunk. Returns `nullptr` if the chunk is full.
+   */
+  void* pop() {
+    void* result = nullptr;
+    if (free) {
+      result = free;
+      free = *reinterpret_cast<void**>(free);
+    } else if (bump + blockSize <= end) {
+      result = bump;
+      bump += blockSize;
+    }
+    if (result) {
+      ++nlive;
+    }
+    return result;
+  }
+
+  /**
+   * Return a block to the chunk.
+   */
+  void push(void* block) {
+    assert(of(block) == this);
+    assert(nlive > 0u);
+    *reinterpret_cast<void**>(block) = free;
+    free = block;
+    --nlive;
+  }
+
+  /**
+   * Next chunk in list.
+   */
+  Chunk* next;
+
+  /**
+   * Previous chunk in list.
+   */
+  Chunk* prev;
+
+  /**
+   * Free list of blocks returned to the chunk. As each block is at least 8
+   * bytes in size, when free its first 8 bytes are used to store a pointer
+   * to the next block in the list.
+   */
+  void* free;
+
+  /**
+   * Start of the untouched remainder of the chunk.
+   */
+  char* bump;
+
+  /**
+   * End of the chunk.
+   */
+  char* end;
+
+  /**
+   * Size of blocks, in bytes.
+   */
+  size_t blockSize;
+
+  /**
+   * Number of blocks in use.
+   */
+  unsigned nlive;
+
+  /**
+   * Size class of blocks.
+   */
+  int bin;
+
+  /**
+   * Id of the owning thread.
+   */
+  int tid;
+
+  /**
+   * Is the chunk on its pool's list of partially used chunks?
+   */
+  bool partial;
+};
+}
@@ -7,6 +7,7 @@
 #include "libbirch/Array.hpp"
 #include "libbirch/Optional.hpp"
 #include "libbirch/Lazy.hpp"
+#include "libbirch/Allocator.hpp"
 
 namespace libbirch {
 /**
@@ -106,26 +107,43 @@ private:
 };
 
 /**
- * Clone an object via a pointer.
+ * Finish and freeze an object, and its label, in preparation for cloning
+ * it.
  *
  * @ingroup libbirch
  *
- * @param o The pointer.
+ * @param ptr The object.
+ * @param label Its label.
  */
-template<class P>
-auto clone(const Lazy<P>& o) {
-  auto ptr = o.pull();
-  auto label = o.getLabel();
-
+template<class T>
+void finish_and_freeze(T* ptr, Label* label) {
   finish_lock.enter();
   ptr->finish(label);
+  visit_deferred();
   label->finish(label);
+  visit_deferred();
   finish_lock.exit();
 
   freeze_lock.enter();
   ptr->freeze();
+  visit_deferred();
   label->freeze();
+  visit_deferred();
   freeze_lock.exit();
+}
+
+/**
+ * Clone an object via a pointer.
+ *
+ * @ingroup libbirch
+ *
+ * @param o The pointer.
+ */
+template<class P>
+auto clone(const Lazy<P>& o) {
+  auto ptr = o.pull();
+  auto label = o.getLabel();
+  finish_and_freeze(ptr, label);
 
   /* shared counts on labels are handled by Any, not Lazy; consequently we
    * need to complete the first copy in order to create a shared pointer to
@@ -135,4 +153,35 @@ auto clone(const Lazy<P>& o) {
   return Lazy<P>(newPtr, newLabel);
 }
 
+/**
+ * Clone an object via a pointer, several times. This is equivalent to
+ * calling clone(const Lazy<P>&) @p k times, but finishes and freezes the
+ * object once only, and copies the memo of its label once only, to a frozen
+ * memo that the labels of the clones share (see Label::copyMany()).
+ *
+ * @ingroup libbirch
+ *
+ * @param o The pointer.
+ * @param k Number of clones.
+ *
+ * @return Vector of clones.
+ */
+template<class P>
+auto clone(const Lazy<P>& o, const int64_t k) {
+  using shape_type = Shape<Dimension<>,EmptyShape>;
+  auto ptr = o.pull();
+  auto label = o.getLabel();
+  std::vector<Label*,Allocator<Label*>> labels(k);
+  if (k > 0) {
+    finish_and_freeze(ptr, label);
+    label->copyMany(k, labels.data());
+  }
+  auto l = [&](const int64_t i) {
+    auto newLabel = labels[i];
+    auto newPtr = newLabel->copy(ptr);
+    return Lazy<P>(newPtr, newLabel);
+  };
+  return Array<Lazy<P>,shape_type>(l, shape_type(k));
+}
+
 }
@@ -21,6 +21,15 @@ using EigenMatrix = Eigen::Matrix<Type,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowM
 template<class Type>
 using EigenMatrixMap = Eigen::Map<EigenMatrix<Type>,Eigen::DontAlign,EigenMatrixStride>;
 
+/*
+ * Maps for arrays with contiguous storage, the first element aligned to
+ * Buffer::ALIGNMENT.
+ */
+template<class Type>
+using EigenVectorAlignedMap = Eigen::Map<EigenVector<Type>,Eigen::Aligned64>;
+template<class Type>
+using EigenMatrixAlignedMap = Eigen::Map<EigenMatrix<Type>,Eigen::Aligned64>;
+
 /*
  * Eigen type for an array type.
  */
@@ -33,6 +42,19 @@ struct eigen_type {
     void>::type>::type;
 };
 
+/*
+ * Eigen type for an array type, where the array has contiguous storage and
+ * is aligned.
+ */
+template<class ArrayType>
+struct eigen_aligned_type {
+  using type = typename std::conditional<ArrayType::shape_type::count() == 2,
+      EigenMatrixAlignedMap<typename ArrayType::value_type>,
+    typename std::conditional<ArrayType::shape_type::count() == 1,
+      EigenVectorAlignedMap<typename ArrayType::value_type>,
+    void>::type>::type;
+};
+
 template<class ArrayType>
 struct eigen_stride_type {
   using type = typename std::conditional<ArrayType::shape_type::count() == 2,
@@ -4,6 +4,7 @@
 #pragma once
 
 #include "libbirch/Atomic.hpp"
+#include "libbirch/wait.hpp"
 
 namespace libbirch {
 /**
@@ -37,7 +38,8 @@ public:
 
 private:
   /**
-   * Number of threads in critical region.
+   * Number of threads in critical region, with the PARKED bit set if
+   * threads are parked waiting at the exit barrier.
    */
   Atomic<unsigned> ninternal;
 };
@@ -53,9 +55,7 @@ inline void libbirch::ExitBarrierLock::enter() {
 }
 
 inline void libbirch::ExitBarrierLock::exit() {
-  if (--ninternal == 0) {
-    return;
-  } else {
-    while (ninternal.load() != 0);  // spin until the entry gate is open
+  if (decrement_wake(ninternal) != 0u) {
+    wait_zero(ninternal);  // wait until the entry gate is open
   }
 }
@@ -14,28 +14,69 @@ libbirch::Label::Label(const Label& o) :
   o1.memo.rehash();
   o1.lock.downgrade();
   memo.copy(o1.memo);
+  parent = o1.parent;
   o1.lock.unsetRead();
 }
 
+void libbirch::Label::copyMany(const int64_t k, Label** labels) {
+  assert(k > 0);
+  lock.setWrite();
+  memo.rehash();
+  lock.downgrade();
+
+  /* combine the memo with that of the parent, so that the parent of the
+   * copies is never more than one level deep; if the memo is empty, the
+   * parent can be shared as is */
+  auto shared = parent.get();
+  if (!memo.empty()) {
+    shared = new Label();
+    shared->memo.copy(memo);
+    if (parent.query()) {
+      shared->memo.putAll(parent->memo);
+    }
+  }
+  lock.unsetRead();
+
+  for (int64_t i = 0; i < k; ++i) {
+    labels[i] = new Label();
+    labels[i]->parent.replace(shared);
+  }
+}
+
+libbirch::Any* libbirch::Label::lookup(Any* o, bool& inherited) {
+  auto next = memo.get(o);
+  inherited = false;
+  if (!next && parent.query()) {
+    next = parent->memo.get(o);
+    inherited = next != nullptr;
+  }
+  return next;
+}
+
 libbirch::Any* libbirch::Label::mapGet(Any* o) {
   Any* prev = nullptr;
   Any* next = o;
   bool frozen = o->isFrozen();
+  bool inherited = false;
   while (frozen && next) {
     prev = next;
-    next = memo.get(prev);
+    bool found;
+    next = lookup(prev, found);
     if (next) {
       frozen = next->isFrozen();
+      inherited = found;
     }
   }
   if (!next) {
 	  next = prev;
 	}
   if (frozen) {
-    if (next->isUnique()) {
+    if (next->isUnique() && (!inherited || parent->numShared() == 1u)) {
       /* final-reference optimization: the pointer being updated is the final
        * remaining pointer to the object, rather than copying the object and
-       * then destroying it, recycle the object to be the copy */
+       * then destroying it, recycle the object to be the copy; where that
+       * pointer is in the memo of the parent, this is only so if no other
+       * label shares the parent */
       next->recycle(this);
     } else {
       /* copy the object */
@@ -59,9 +100,10 @@ libbirch::Any* libbirch::Label::mapPull(Any* o) {
   Any* prev = nullptr;
   Any* next = o;
   bool frozen = o->isFrozen();
+  bool inherited;
   while (frozen && next) {
     prev = next;
-    next = memo.get(prev);
+    next = lookup(prev, inherited);
     if (next) {
       frozen = next->isFrozen();
     }
@@ -11,6 +11,12 @@ namespace libbirch {
  * Label for bookkeeping lazy deep clones.
  *
  * @ingroup libbirch
+ *
+ * Objects that have already been copied are looked up in the memo
+ * optimistically, within a read-side critical region (see enter_read()),
+ * without taking the lock, so that threads sharing a label do not contend
+ * to read through it. The lock is taken for writing only to copy an
+ * object, and for reading by operations that visit the whole memo.
  */
 class Label final : public Any {
 public:
@@ -24,6 +30,18 @@ public:
    */
   Label(const Label& o);
 
+  /**
+   * Make several copies at once, for a batch of deep clones of the same
+   * object. Rather than each copy having its own copy of the memo, as with
+   * the copy constructor, the memo is copied once, combined with that of
+   * the parent, if any, into a frozen memo that the copies share as their
+   * parent, each holding only the new entries that it makes itself.
+   *
+   * @param k Number of copies, positive.
+   * @param[out] labels Array of length @p k to receive the copies.
+   */
+  void copyMany(const int64_t k, Label** labels);
+
   /**
    * Update a smart pointer for writing.
    *
@@ -33,14 +51,28 @@ public:
   auto get(P& o)  {
     auto ptr = o.get();
     if (ptr && ptr->isFrozen()) {  // isFrozen a useful guard for performance
-      lock.setWrite();
+      /* optimistically, the object has already been copied, in which case
+       * it can be found without the write lock */
+      enter_read();
       ptr = o.get();  // reload now that within critical region
       auto old = ptr;
-      ptr = static_cast<typename P::value_type*>(mapGet(old));
-      if (ptr != old) {
+      ptr = static_cast<typename P::value_type*>(mapPull(old));
+      bool copied = !ptr->isFrozen();
+      if (copied && ptr != old) {
         o.replace(ptr);
       }
-      lock.unsetWrite();
+      exit_read();
+
+      if (!copied) {
+        lock.setWrite();
+        ptr = o.get();  // reload now that within critical region
+        auto old = ptr;
+        ptr = static_cast<typename P::value_type*>(mapGet(old));
+        if (ptr != old) {
+          o.replace(ptr);
+        }
+        lock.unsetWrite();
+      }
     }
     return ptr;
   }
@@ -54,14 +86,14 @@ public:
   auto pull(P& o) {
     auto ptr = o.get();
     if (ptr && ptr->isFrozen()) {  // isFrozen a useful guard for performance
-      lock.setRead();
+      enter_read();
       ptr = o.get();  // reload now that within critical region
       auto old = ptr;
       ptr = static_cast<typename P::value_type*>(mapPull(old));
       if (ptr != old) {
         o.replace(ptr);
       }
-      lock.unsetRead();
+      exit_read();
     }
     return ptr;
   }
@@ -74,9 +106,18 @@ public:
   template<class T>
   auto get(T* ptr)  {
     if (ptr && ptr->isFrozen()) {  // isFrozen a useful guard for performance
-      lock.setWrite();
-      ptr = static_cast<T*>(mapGet(ptr));
-      lock.unsetWrite();
+      enter_read();
+      auto next = static_cast<T*>(mapPull(ptr));
+      bool copied = !next->isFrozen();
+      exit_read();
+
+      if (copied) {
+        ptr = next;
+      } else {
+        lock.setWrite();
+        ptr = static_cast<T*>(mapGet(ptr));
+        lock.unsetWrite();
+      }
     }
     return ptr;
   }
@@ -111,6 +152,17 @@ public:
   }
 
 private:
+  /**
+   * Look up an object in the memo and, if not found there, in the memo of
+   * the parent.
+   *
+   * @param o The object.
+   * @param[out] inherited Set to true if found in the memo of the parent.
+   *
+   * @return The object to which @p o maps, or null if none.
+   */
+  Any* lookup(Any* o, bool& inherited);
+
   /**
    * Map an object that may not yet have been cloned, cloning it if
    * necessary.
@@ -119,7 +171,8 @@ private:
 
   /**
    * Map an object that may not yet have been cloned, without cloning it.
-   * This is used as an optimization for read-only access.
+   * This is used as an optimization for read-only access, and requires
+   * only a read-side critical region.
    */
   Any* mapPull(Any* o);
 
@@ -133,6 +186,14 @@ private:
    */
   Memo memo;
 
+  /**
+   * Parent, shared with other labels, or null. This is a label made by
+   * copyMany() only to hold a frozen memo, which is never modified, so may
+   * be read without its lock. Objects not found in the memo are looked up
+   * in that of the parent.
+   */
+  LabelPtr parent;
+
   /**
    * Lock.
    */
@@ -148,14 +209,20 @@ public:
   }
 
   virtual void finish_(libbirch::Label* label) override {
+    /* the memo may be rehashed once the lock is released, destroying
+     * values, so visits to them must complete first */
     lock.setRead();
+    auto n = num_deferred();
     memo.finish(label);
+    visit_deferred(n);
     lock.unsetRead();
   }
 
   virtual void freeze_() override {
     lock.setRead();
+    auto n = num_deferred();
     memo.freeze();
+    visit_deferred(n);
     lock.unsetRead();
   }
 
@@ -169,18 +236,22 @@ public:
 
   virtual void mark_() override {
     memo.mark();
+    parent.mark();
   }
 
   virtual void scan_() override {
     memo.scan();
+    parent.scan();
   }
 
   virtual void reach_() override {
     memo.reach();
+    parent.reach();
   }
 
   virtual void collect_() override {
     memo.collect();
+    parent.collect();
   }
 
   using base_type = Any;
@@ -5,12 +5,17 @@
 
 #include "libbirch/external.hpp"
 #include "libbirch/Atomic.hpp"
+#include "libbirch/wait.hpp"
 
 namespace libbirch {
 /**
  * Lock with exclusive use semantics.
  *
  * @ingroup libbirch
+ *
+ * A thread that finds the lock held spins with backoff, then parks until
+ * it is released (see wait.hpp). The lock records whether threads may be
+ * parked, so that releasing an uncontended lock requires no system call.
  */
 class Lock {
 public:
@@ -18,7 +23,7 @@ public:
    * Constructor.
    */
   Lock() :
-    lock(false) {
+    lock(0) {
     //
   }
 
@@ -35,29 +40,74 @@ public:
    * Correctly initialize after a bitwise copy.
    */
   void bitwiseFix() {
-    lock.store(false);
+    lock.store(0);
   }
 
   /**
    * Obtain exclusive use.
    */
   void set() {
-    /* spin, setting the lock true until its old value comes back false */
-    while (lock.exchange(true));
+    int expected = 0;
+    if (!lock.compareExchange(expected, 1)) {
+      setSlow();
+    }
   }
 
-
   /**
    * Release exclusive use.
    */
   void unset() {
-    lock.store(false);
+    if (lock.exchange(0) == 2) {
+      unpark_all(lock);
+    }
+  }
+
+  /**
+   * Wait until the lock is not held, without obtaining it.
+   */
+  void wait() {
+    Backoff backoff;
+    int c;
+    while ((c = lock.load()) != 0) {
+      if (!backoff.spin()) {
+        if (c == 2 || lock.compareExchange(c, 2)) {
+          park(lock, 2);
+        }
+      }
+    }
+  }
+
+  /**
+   * Is the lock held?
+   */
+  bool isSet() const {
+    return lock.load() != 0;
   }
 
 private:
   /**
-   * Lock.
+   * Obtain exclusive use, where the lock is contended.
+   */
+  void setSlow() {
+    Backoff backoff;
+    while (backoff.spin()) {
+      int expected = 0;
+      if (lock.load() == 0 && lock.compareExchange(expected, 1)) {
+        return;
+      }
+    }
+
+    /* park, marking the lock as having parked threads; once obtained in
+     * this way, the lock remains so marked, as others may still be parked */
+    while (lock.exchange(2) != 0) {
+      park(lock, 2);
+    }
+  }
+
+  /**
+   * Lock: zero if not held, one if held, two if held and threads may be
+   * parked waiting for it.
    */
-  Atomic<bool> lock;
+  Atomic<int> lock;
 };
 }
@@ -5,96 +5,202 @@
 
 #include "libbirch/Any.hpp"
 
+/**
+ * Index of the lowest set bit of a nonzero mask.
+ */
+inline unsigned lowest_bit(const unsigned m) {
+  assert(m > 0u);
+  #ifdef HAVE___BUILTIN_CTZ
+  return unsigned(__builtin_ctz(m));
+  #else
+  unsigned result = 0u;
+  while (!((m >> result) & 1u)) {
+    ++result;
+  }
+  return result;
+  #endif
+}
+
 libbirch::Memo::Memo() :
-    keys(nullptr),
-    values(nullptr),
-    nentries(0u),
-    tentries(0u),
+    table(nullptr),
     noccupied(0u),
     nnew(0u) {
   //
 }
 
 libbirch::Memo::~Memo() {
-  if (nentries > 0u) {
-    for (unsigned i = 0u; i < nentries; ++i) {
-      auto key = keys[i];
-      if (key) {
+  auto t = table.load();
+  if (t) {
+    releaseTable(t, nullptr);
+  }
+}
+
+unsigned libbirch::Memo::match(const uint8_t* ctrl, const uint8_t c) {
+  #ifdef __SSE2__
+  auto group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+  return unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(group,
+      _mm_set1_epi8(static_cast<char>(c)))));
+  #else
+  unsigned mask = 0u;
+  for (unsigned i = 0u; i < GROUP; ++i) {
+    mask |= unsigned(ctrl[i] == c) << i;
+  }
+  return mask;
+  #endif
+}
+
+int libbirch::Memo::find(table_type* table, const key_type key) {
+  auto entries = table->entries();
+  auto ctrl = table->ctrl();
+  auto h = hash(key);
+  auto c = uint8_t(h >> 57u);
+  auto mask = table->nentries/GROUP - 1u;
+  auto g = unsigned(h >> 25u) & mask;
+  for (unsigned step = 1u; ; ++step) {
+    auto base = g*GROUP;
+    auto m = match(ctrl + base, c);
+    while (m) {
+      /* match() reads the group of control bytes together, and not
+       * atomically, so re-read the control byte of a candidate entry
+       * atomically before its key; this pairs with the store in insert(),
+       * so that the entry is filled by the time its control byte is seen */
+      auto i = base + lowest_bit(m);
+      if (__atomic_load_n(&ctrl[i], __ATOMIC_ACQUIRE) == c &&
+          entries[i].key == key) {
+        return int(i);
+      }
+      m &= m - 1u;
+    }
+    if (match(ctrl + base, EMPTY)) {
+      return -1;
+    }
+    g = (g + step) & mask;
+  }
+}
+
+void libbirch::Memo::insert(table_type* table, const key_type key,
+    const value_type value) {
+  auto entries = table->entries();
+  auto ctrl = table->ctrl();
+  auto h = hash(key);
+  auto c = uint8_t(h >> 57u);
+  auto mask = table->nentries/GROUP - 1u;
+  auto g = unsigned(h >> 25u) & mask;
+  for (unsigned step = 1u; ; ++step) {
+    auto base = g*GROUP;
+    auto m = match(ctrl + base, EMPTY);
+    if (m) {
+      auto i = base + lowest_bit(m);
+      entries[i].key = key;
+      entries[i].value = value;
+      __atomic_store_n(&ctrl[i], c, __ATOMIC_RELEASE);
+      return;
+    }
+    g = (g + step) & mask;
+  }
+}
+
+libbirch::Memo::table_type* libbirch::Memo::allocateTable(const unsigned n) {
+  assert(n % GROUP == 0u);
+  auto ptr = allocate(sizeof(table_type) + n*(sizeof(entry_type) +
+      sizeof(uint8_t)));
+  auto table = static_cast<table_type*>(ptr);
+  table->nentries = n;
+  table->tid = get_thread_num();
+  std::memset(table->ctrl(), EMPTY, n);
+  return table;
+}
+
+void libbirch::Memo::deallocateTable(table_type* table) {
+  auto n = table->nentries;
+  deallocate(table, sizeof(table_type) + n*(sizeof(entry_type) +
+      sizeof(uint8_t)), table->tid);
+}
+
+void libbirch::Memo::releaseTable(table_type* table, table_type* next) {
+  auto entries = table->entries();
+  auto ctrl = table->ctrl();
+  for (auto i = 0u; i < table->nentries; ++i) {
+    if (ctrl[i] != EMPTY) {
+      auto key = entries[i].key;
+      auto value = entries[i].value;
+      if (!next || find(next, key) < 0) {
         key->decMemo();
-        auto value = values[i];
-        if (value) {  // may be null if collect() already destroyed
-          value->decShared();
-        }
+      }
+      if (value) {  // may be null if collect() already destroyed
+        value->decShared();
       }
     }
-    deallocate(keys, nentries * sizeof(key_type), tentries);
-    deallocate(values, nentries * sizeof(value_type), tentries);
   }
+  deallocateTable(table);
 }
 
 libbirch::Memo::value_type libbirch::Memo::get(const key_type key,
     const value_type failed) {
   assert(key);
-
-  auto value = failed;
-  if (!empty()) {
-    auto i = hash(key, nentries);
-    auto k = keys[i];
-    while (k && k != key) {
-      i = (i + 1u) & (nentries - 1u);
-      k = keys[i];
-    }
-    if (k == key) {
-      value = values[i];
+  auto t = table.load();
+  if (t) {
+    auto i = find(t, key);
+    if (i >= 0) {
+      return t->entries()[i].value;
     }
   }
-  return value;
+  return failed;
 }
 
 void libbirch::Memo::put(const key_type key, const value_type value) {
   assert(key);
   assert(value);
+  assert(get(key) == nullptr);
 
   key->incMemo();
   value->incShared();
 
   reserve();
-  auto i = hash(key, nentries);
-  auto k = keys[i];
-  while (k) {
-    assert(k != key);
-    i = (i + 1u) & (nentries - 1u);
-    k = keys[i];
-  }
-  keys[i] = key;
-  values[i] = value;
+  insert(table.load(), key, value);
 }
 
 void libbirch::Memo::copy(const Memo& o) {
   assert(empty());
 
   /* strategy here is to assume the parent has been rehashed to reduce its
-   * size and remove unreachable entries, so now just copy entry-by-entry */
-  if (o.nentries > 0u) {
-    /* allocate */
-    keys = (key_type*)allocate(o.nentries * sizeof(key_type));
-    values = (value_type*)allocate(o.nentries * sizeof(value_type));
-    nentries = o.nentries;
-    tentries = get_thread_num();
+   * size and remove unreachable entries, so now just copy the table as is */
+  auto ot = o.table.load();
+  if (ot) {
+    auto n = ot->nentries;
+    auto t = allocateTable(n);
+    std::memcpy(t->entries(), ot->entries(), n*(sizeof(entry_type) +
+        sizeof(uint8_t)));
     noccupied = o.noccupied;
     nnew = o.nnew;
 
-    /* copy entry-by-entry, incrementing reference counts for non-null
-     * entries */
-    for (auto i = 0u; i < nentries; ++i) {
-      auto key = o.keys[i];
-      auto value = o.values[i];
-      if (key) {
-        key->incMemo();
-        value->incShared();
+    /* increment reference counts for occupied entries */
+    auto entries = t->entries();
+    auto ctrl = t->ctrl();
+    for (auto i = 0u; i < n; ++i) {
+      if (ctrl[i] != EMPTY) {
+        entries[i].key->incMemo();
+        auto value = entries[i].value;
+        if (value) {
+          value->incShared();
+        }
+      }
+    }
+    table.store(t);
+  }
+}
+
+void libbirch::Memo::putAll(const Memo& o) {
+  auto ot = o.table.load();
+  if (ot) {
+    auto entries = ot->entries();
+    auto ctrl = ot->ctrl();
+    for (auto i = 0u; i < ot->nentries; ++i) {
+      auto key = entries[i].key;
+      auto value = entries[i].value;
+      if (ctrl[i] != EMPTY && value && !key->isDestroyed()) {
+        put(key, value);
       }
-      keys[i] = key;
-      values[i] = value;
     }
   }
 }
@@ -102,7 +208,8 @@ void libbirch::Memo::copy(const Memo& o) {
 void libbirch::Memo::reserve() {
   ++nnew;
   ++noccupied;
-  if (noccupied > crowd()) {
+  auto t = table.load();
+  if (!t || noccupied > crowd(t->nentries)) {
     rehash();
   }
 }
@@ -110,155 +217,152 @@ void libbirch::Memo::reserve() {
 void libbirch::Memo::rehash() {
   if (nnew > 0u) {  // no need to rehash if no new entries since last time
     nnew = 0u;
+    auto t1 = table.load();
+    unsigned n1 = 0u;
     unsigned nremoved = 0u;
-
-    /* first pass, apply the table to itself; this has the effect of
-     * replacing a -> b and b -> c with a -> c and b -> c, which may allow
-     * b to be collected sooner */
-    for (auto i = 0u; i < nentries; ++i) {
-      auto value = values[i];
-      if (value) {
-        auto prev = value;
-        auto next = value;
-        do {
-          prev = next;
-          next = get(prev);
-        } while (next);
-        if (prev != value) {
-          prev->incShared();
-          value->decShared();
-          values[i] = prev;
+    if (t1) {
+      n1 = t1->nentries;
+      auto entries1 = t1->entries();
+      auto ctrl1 = t1->ctrl();
+      for (auto i = 0u; i < n1; ++i) {
+        if (ctrl1[i] != EMPTY && entries1[i].key->isDestroyed()) {
+          ++nremoved;
         }
       }
     }
-
-    /* second pass, delete any entries where the key is no longer reachable;
-     * from this point, the old buffers are no long valid as a hash table */
-    for (auto i = 0u; i < nentries; ++i) {
-      auto key = keys[i];
-      if (key && key->isDestroyed()) {
-        auto value = values[i];
-        key->decMemo();
-        value->decShared();
-        keys[i] = nullptr;
-        values[i] = nullptr;
-        ++nremoved;
-      }
-    }
     noccupied -= nremoved;
 
-    if (noccupied == 0u) {
-      /* deallocate previous table */
-      if (nentries > 0) {
-        deallocate(keys, nentries * sizeof(key_type), tentries);
-        deallocate(values, nentries * sizeof(value_type), tentries);
-      }
-
-      /* new table empty */
-      nentries = 0u;
-      tentries = 0u;
-      keys = nullptr;
-      values = nullptr;
-    } else {
-      /* save previous table */
-      auto nentries1 = nentries;
-      auto tentries1 = tentries;
-      auto keys1 = keys;
-      auto values1 = values;
-
-      /* choose an appropriate size for the new table */
-      unsigned minSize = 8u;
-      nentries = std::max(2u*nentries1, minSize);
-      while (minSize < nentries && noccupied <= crowd()/2) {
-        nentries /= 2u;
+    /* choose an appropriate size for the new table; noccupied may include
+     * an entry about to be inserted by put() */
+    table_type* t2 = nullptr;
+    if (noccupied > 0u) {
+      auto n2 = std::max(2u*n1, GROUP);
+      while (GROUP < n2 && noccupied <= crowd(n2)/2u) {
+        n2 /= 2u;
       }
+      t2 = allocateTable(n2);
+    }
 
-      if (nentries != nentries1 || nremoved > 0u) {
-        /* allocate the new table */
-        keys = (key_type*)allocate(nentries * sizeof(key_type));
-        values = (value_type*)allocate(nentries * sizeof(value_type));
-        std::memset(keys, 0, nentries * sizeof(key_type));
-        std::memset(values, 0, nentries * sizeof(value_type));
-        tentries = get_thread_num();
-
-        /* copy entries from previous table */
-        for (auto i = 0u; i < nentries1; ++i) {
-          auto key = keys1[i];
-          if (key) {
-            auto j = hash(key, nentries);
-            while (keys[j]) {
-              j = (j + 1u) & (nentries - 1u);
-            }
-            keys[j] = key;
-            values[j] = values1[i];
+    /* copy entries where the key is still reachable to the new table, and
+     * apply the old table to itself for their values; this has the effect
+     * of replacing a -> b and b -> c with a -> c and b -> c, which may allow
+     * b to be collected sooner */
+    if (t1 && t2) {
+      auto entries1 = t1->entries();
+      auto ctrl1 = t1->ctrl();
+      for (auto i = 0u; i < n1; ++i) {
+        auto key = entries1[i].key;
+        if (ctrl1[i] != EMPTY && !key->isDestroyed()) {
+          auto value = entries1[i].value;
+          if (value) {
+            Any* next = value;
+            do {
+              value = next;
+              auto j = find(t1, value);
+              next = (j >= 0) ? entries1[j].value : nullptr;
+            } while (next);
+            value->incShared();
           }
-        }
-
-        /* deallocate previous table */
-        if (nentries1 > 0u) {
-          deallocate(keys1, nentries1 * sizeof(key_type), tentries1);
-          deallocate(values1, nentries1 * sizeof(value_type), tentries1);
+          insert(t2, key, value);
         }
       }
     }
+
+    /* publish the new table, then release the old table once no thread can
+     * still be reading it */
+    table.store(t2);
+    if (t1) {
+      synchronize_reads();
+      releaseTable(t1, t2);
+    }
   }
 }
 
 void libbirch::Memo::finish(Label* label) {
-  for (auto i = 0u; i < nentries; ++i) {
-    auto key = keys[i];
-    if (key && !key->isDestroyed()) {
-      auto value = values[i];
-      value->finish(label);
+  auto t = table.load();
+  if (t) {
+    auto entries = t->entries();
+    auto ctrl = t->ctrl();
+    for (auto i = 0u; i < t->nentries; ++i) {
+      auto key = entries[i].key;
+      if (ctrl[i] != EMPTY && !key->isDestroyed()) {
+        auto value = entries[i].value;
+        value->finish(label);
+      }
     }
   }
 }
 
 void libbirch::Memo::freeze() {
-  for (auto i = 0u; i < nentries; ++i) {
-    auto key = keys[i];
-    if (key && !key->isDestroyed()) {
-      auto value = values[i];
-      value->freeze();
+  auto t = table.load();
+  if (t) {
+    auto entries = t->entries();
+    auto ctrl = t->ctrl();
+    for (auto i = 0u; i < t->nentries; ++i) {
+      auto key = entries[i].key;
+      if (ctrl[i] != EMPTY && !key->isDestroyed()) {
+        auto value = entries[i].value;
+        value->freeze();
+      }
     }
   }
 }
 
 void libbirch::Memo::mark() {
-  for (auto i = 0u; i < nentries; ++i) {
-    auto value = values[i];
-    if (value) {
-      value->decSharedReachable();  // break the reference
-      value->mark();
+  auto t = table.load();
+  if (t) {
+    auto entries = t->entries();
+    auto ctrl = t->ctrl();
+    for (auto i = 0u; i < t->nentries; ++i) {
+      auto value = entries[i].value;
+      if (ctrl[i] != EMPTY && value) {
+        value->decSharedReachable();  // break the reference
+        value->mark();
+      }
     }
   }
 }
 
 void libbirch::Memo::scan() {
-  for (auto i = 0u; i < nentries; ++i) {
-    auto value = values[i];
-    if (value) {
-      value->scan();
+  auto t = table.load();
+  if (t) {
+    auto entries = t->entries();
+    auto ctrl = t->ctrl();
+    for (auto i = 0u; i < t->nentries; ++i) {
+      auto value = entries[i].value;
+      if (ctrl[i] != EMPTY && value) {
+        value->scan();
+      }
     }
   }
 }
 
 void libbirch::Memo::reach() {
-  for (auto i = 0u; i < nentries; ++i) {
-    auto value = values[i];
-    if (value) {
-      value->incShared();  // restore the broken reference
-      value->reach();
+  auto t = table.load();
+  if (t) {
+    auto entries = t->entries();
+    auto ctrl = t->ctrl();
+    for (auto i = 0u; i < t->nentries; ++i) {
+      auto value = entries[i].value;
+      if (ctrl[i] != EMPTY && value) {
+        value->incShared();  // restore the broken reference
+        value->reach();
+      }
     }
   }
 }
 
 void libbirch::Memo::collect() {
-  for (auto i = 0u; i < nentries; ++i) {
-    auto value = values[i];
-    if (value) {
-      values[i] = nullptr;
-      value->collect();
+  auto t = table.load();
+  if (t) {
+    auto entries = t->entries();
+    auto ctrl = t->ctrl();
+    for (auto i = 0u; i < t->nentries; ++i) {
+      auto value = entries[i].value;
+      if (ctrl[i] != EMPTY && value) {
+        entries[i].value = nullptr;
+        value->collect();
+      }
     }
   }
 }
@@ -13,6 +13,29 @@ class Label;
  * Memo of object mappings, implemented as a hash table.
  *
  * @ingroup libbirch
+ *
+ * The table is open addressing in the style of a Swiss table. Entries are
+ * arranged in groups of 16, each entry a key and value side by side. A
+ * separate array of control bytes, one per entry, records whether each
+ * entry is empty and, if not, seven bits of the hash of its key. A lookup
+ * compares all 16 control bytes of a group at once (using SSE2 where
+ * available) to find the few candidate entries whose keys need be compared,
+ * and stops at the first group with an empty entry. Groups are probed in
+ * triangular sequence, which visits each group once when the number of
+ * groups is a power of two.
+ *
+ * Entries are only removed by rehash(), which rebuilds the table, so there
+ * is no need for tombstones.
+ *
+ * Writers (put(), rehash() and copy()) must be serialized, but get() may be
+ * called concurrently with them from within a read-side critical region
+ * (see enter_read()). To support this, the table, including its size, is a
+ * single allocation published through one atomic pointer; put() fills an
+ * entry before it stores its control byte, with release semantics, and
+ * get() loads the control byte of a candidate entry, with acquire
+ * semantics, before it reads the entry; rehash() builds a new table rather
+ * than modifying the old one, and only releases the old one, along with
+ * the references that it holds, after synchronize_reads().
  */
 class Memo {
 public:
@@ -48,6 +71,9 @@ public:
    *
    * @return If @p key exists, then its associated value, otherwise
    * @p failed.
+   *
+   * This may be called concurrently with writers, from within a read-side
+   * critical region.
    */
   value_type get(const key_type key, const value_type failed = nullptr);
 
@@ -65,6 +91,12 @@ public:
    */
   void copy(const Memo& o);
 
+  /**
+   * Put all entries from another map into this one, skipping any that are
+   * obsolete. None of their keys may already be in this one.
+   */
+  void putAll(const Memo& o);
+
   /**
    * Rehash the table. This will also remove unreachable entries.
    */
@@ -102,42 +134,120 @@ public:
 
 private:
   /**
-   * Compute the hash code for a given key for a table with the given number
-   * of entries.
+   * Entry.
    */
-  static unsigned hash(const key_type key, const unsigned nentries);
+  struct entry_type {
+    key_type key;
+    value_type value;
+  };
 
   /**
-   * Compute the lower bound on the number of occupied entries before the
-   * table is considered too crowded.
+   * Table. This is the header of a single allocation, followed by the
+   * entries, then the control bytes.
    */
-  unsigned crowd() const;
+  struct table_type {
+    /**
+     * Number of entries.
+     */
+    unsigned nentries;
+
+    /**
+     * Id of the thread that allocated the table.
+     */
+    int tid;
+
+    /**
+     * The entries.
+     */
+    entry_type* entries() {
+      return reinterpret_cast<entry_type*>(this + 1);
+    }
+
+    /**
+     * The control bytes.
+     */
+    uint8_t* ctrl() {
+      return reinterpret_cast<uint8_t*>(entries() + nentries);
+    }
+  };
 
   /**
-   * Reserve space for a new entry, rehashing the table if it has become
-   * too crowded.
+   * Number of entries in a group.
    */
-  void reserve();
-  
+  static constexpr unsigned GROUP = 16u;
+
   /**
-   * The keys.
+   * Control byte for an empty entry. Control bytes for occupied entries
+   * have the high bit unset.
    */
-  key_type* keys;
+  static constexpr uint8_t EMPTY = 0x80u;
 
   /**
-   * The values.
+   * Compute the hash code for a given key.
    */
-  value_type* values;
+  static uint64_t hash(const key_type key);
 
   /**
-   * Number of entries in the table.
+   * Mask of entries in a group whose control bytes match a given value.
+   *
+   * @param ctrl Control bytes of the group.
+   * @param c Value.
+   *
+   * @return Bit mask, with bit @c i set if entry @c i matches.
    */
-  unsigned nentries;
+  static unsigned match(const uint8_t* ctrl, const uint8_t c);
+
+  /**
+   * Find the entry for a key in a table.
+   *
+   * @return Index of the entry, or -1 if not found.
+   */
+  static int find(table_type* table, const key_type key);
+
+  /**
+   * Insert a key and value into a table without checking whether it is
+   * crowded.
+   */
+  static void insert(table_type* table, const key_type key,
+      const value_type value);
+
+  /**
+   * Allocate a table, with all entries empty.
+   *
+   * @param n Number of entries, a power of two and multiple of GROUP.
+   */
+  static table_type* allocateTable(const unsigned n);
+
+  /**
+   * Deallocate a table.
+   */
+  static void deallocateTable(table_type* table);
+
+  /**
+   * Release the references held by a table, then deallocate it.
+   *
+   * @param table The table.
+   * @param next The table that replaces it, or null. Keys found in this
+   * table have been moved to it, and are not released.
+   */
+  static void releaseTable(table_type* table, table_type* next);
+
+  /**
+   * Compute the lower bound on the number of occupied entries before a
+   * table of a given size is considered too crowded.
+   */
+  static unsigned crowd(const unsigned n);
+
+  /**
+   * Reserve space for a new entry, rehashing the table if it has become
+   * too crowded.
+   */
+  void reserve();
 
   /**
-   * Id of the thread that allocated keys and values.
+   * The table, or null if empty.
    */
-  int tentries;
+  Atomic<table_type*> table;
 
   /**
    * Number of occupied entries in the table.
@@ -152,17 +262,20 @@ private:
 }
 
 inline bool libbirch::Memo::empty() const {
-  return nentries == 0u;
+  return table.load() == nullptr;
 }
 
-inline unsigned libbirch::Memo::hash(const key_type key, const unsigned nentries) {
-  assert(nentries > 0u);
-  return static_cast<unsigned>(reinterpret_cast<size_t>(key) >> 6ull)
-      & (nentries - 1u);
+inline uint64_t libbirch::Memo::hash(const key_type key) {
+  /* objects may be as little as 16 bytes apart, so rather than shifting
+   * out low-order bits, mix all bits with a multiplicative hash; the high
+   * seven bits are used for the control byte, the bits below those to
+   * select the group */
+  return reinterpret_cast<uint64_t>(key)*0x9E3779B97F4A7C15ull;
 }
 
-inline unsigned libbirch::Memo::crowd() const {
-  /* the table is considered crowded if more than three-quarters of its
-   * entries are occupied */
-  return (nentries >> 1u) + (nentries >> 2u);
+inline unsigned libbirch::Memo::crowd(const unsigned n) {
+  /* the table is considered crowded if more than seven-eighths of its
+   * entries are occupied; group probing tolerates a higher load than
+   * linear probing on single entries */
+  return n - (n >> 3u);
 }
@@ -3,61 +3,201 @@
  */
 #pragma once
 
-#include "libbirch/Lock.hpp"
-#include "libbirch/memory.hpp"
+#include "libbirch/Atomic.hpp"
+#include "libbirch/Chunk.hpp"
 
 namespace libbirch {
 /**
- * Thread-safe stack of memory allocations.
+ * Pool of memory allocations of a single size, owned by a single thread.
  *
  * @ingroup libbirch
  *
- * The pool is kept as a stack, with blocks removed from the pool by popping
- * the stack, and returned to the pool by pushing the stack. As each
- * block is at least 8 bytes in size, when in the pool (and therefore
- * not in use), its first 8 bytes are used to store a pointer to the next
- * block on the stack. The implementation is lock-free.
+ * The pool allocates from chunks (see Chunk). It keeps a *current* chunk
+ * from which allocations are made, and a list of other *partial* chunks
+ * that have blocks available. All of these are only ever accessed by the
+ * owning thread, and so are unsynchronized; the common case of a thread
+ * allocating and then deallocating a block of its own performs no atomic
+ * operations.
+ *
+ * Blocks deallocated by other threads are pushed onto a *remote* stack
+ * instead. This supports concurrent pushes, and is drained in a single
+ * batch by the owning thread, with one atomic exchange, when the current
+ * chunk is exhausted. The implementation is lock-free.
+ *
+ * Pools are aligned to cache lines to avoid false sharing between threads.
  */
-class Pool {
+class alignas(64) Pool {
 public:
   /**
    * Constructor.
    */
   Pool() :
-      top(nullptr) {
+      current(nullptr),
+      partial(nullptr),
+      remote(nullptr),
+      nchunks(0u),
+      nblocks(0u) {
     //
   }
 
   /**
-   * Is the pool empty?
+   * Pop an allocation from the pool. Returns `nullptr` if no blocks are
+   * available, in which case a new chunk should be provided with
+   * add(). Must only be called by the owning thread.
    */
-  bool empty() const {
-    return !top;
+  void* pop() {
+    void* result = current ? current->pop() : nullptr;
+    if (!result) {
+      /* blocks freed remotely may return to the current chunk, so try it
+       * again before moving on to a partial chunk */
+      drain();
+      result = current ? current->pop() : nullptr;
+      if (!result && partial) {
+        auto chunk = partial;
+        unlink(chunk);
+        replace(chunk);
+        result = current->pop();
+      }
+    }
+    if (result) {
+      ++nblocks;
+    }
+    return result;
   }
 
   /**
-   * Pop an allocation from the pool. Returns `nullptr` if the pool is
-   * empty.
+   * Add a new chunk to the pool, making it the current chunk. Must only be
+   * called by the owning thread.
    */
-  void* pop() {
-    lock.set();
-    auto result = top;
-    top = getNext(result);
-    lock.unset();
-    return result;
+  void add(Chunk* chunk) {
+    replace(chunk);
+    ++nchunks;
+  }
+
+  /**
+   * Push an allocation to the pool. Must only be called by the owning
+   * thread.
+   *
+   * @return If the chunk of the block is now empty, and not the current
+   * chunk, that chunk, which has been removed from the pool and may be
+   * released. Otherwise `nullptr`.
+   */
+  Chunk* push(void* block) {
+    auto chunk = Chunk::of(block);
+    auto full = chunk->full();
+    chunk->push(block);
+    --nblocks;
+    if (chunk != current) {
+      if (chunk->empty()) {
+        if (chunk->partial) {
+          unlink(chunk);
+        }
+        --nchunks;
+        return chunk;
+      } else if (full) {
+        link(chunk);
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * Push an allocation to the pool from a thread other than the owning
+   * thread.
+   */
+  void pushRemote(void* block) {
+    /* only pushes and whole-stack exchanges are performed on the remote
+     * stack, never single pops, so there is no ABA problem here */
+    auto next = remote.load();
+    do {
+      setNext(block, next);
+    } while (!remote.compareExchange(next, block));
   }
 
   /**
-   * Push an allocation to the pool.
+   * Number of chunks in the pool.
    */
-  void push(void* block) {
-    lock.set();
-    setNext(block, top);
-    top = block;
-    lock.unset();
+  size_t numChunks() const {
+    return nchunks;
+  }
+
+  /**
+   * Number of blocks in use. Blocks deallocated by other threads are
+   * counted as in use until the remote stack is next drained.
+   */
+  size_t numBlocks() const {
+    return nblocks;
   }
 
 private:
+  /**
+   * Drain the remote stack, returning its blocks to their chunks. Chunks
+   * that become empty are retained in the pool, rather than released, as
+   * they are about to be needed.
+   */
+  void drain() {
+    if (remote.load()) {
+      /* exchange() also makes the next pointers written by the pushing
+       * threads visible here */
+      auto block = remote.exchange(nullptr);
+      while (block) {
+        auto next = getNext(block);
+        auto chunk = Chunk::of(block);
+        auto full = chunk->full();
+        chunk->push(block);
+        --nblocks;
+        if (full && chunk != current) {
+          link(chunk);
+        }
+        block = next;
+      }
+    }
+  }
+
+  /**
+   * Make a chunk the current chunk. If the previous current chunk still has
+   * blocks available, it is inserted into the list of partial chunks, so
+   * that those blocks are not lost to the pool.
+   */
+  void replace(Chunk* chunk) {
+    if (current && !current->full()) {
+      link(current);
+    }
+    current = chunk;
+  }
+
+  /**
+   * Insert a chunk at the front of the list of partial chunks.
+   */
+  void link(Chunk* chunk) {
+    assert(!chunk->partial);
+    chunk->prev = nullptr;
+    chunk->next = partial;
+    if (partial) {
+      partial->prev = chunk;
+    }
+    partial = chunk;
+    chunk->partial = true;
+  }
+
+  /**
+   * Remove a chunk from the list of partial chunks.
+   */
+  void unlink(Chunk* chunk) {
+    assert(chunk->partial);
+    if (chunk->prev) {
+      chunk->prev->next = chunk->next;
+    } else {
+      partial = chunk->next;
+    }
+    if (chunk->next) {
+      chunk->next->prev = chunk->prev;
+    }
+    chunk->next = nullptr;
+    chunk->prev = nullptr;
+    chunk->partial = false;
+  }
+
   /**
    * Get the first 8 bytes of a block as a pointer.
    */
@@ -74,13 +214,28 @@ private:
   }
 
   /**
-   * Stack of allocations.
+   * Chunk from which allocations are currently made.
+   */
+  Chunk* current;
+
+  /**
+   * List of other chunks with blocks available.
+   */
+  Chunk* partial;
+
+  /**
+   * Remote stack of allocations.
+   */
+  Atomic<void*> remote;
+
+  /**
+   * Number of chunks in the pool.
    */
-  void* top;
+  size_t nchunks;
 
   /**
-   * Mutex.
+   * Number of blocks in use.
    */
-  Lock lock;
+  size_t nblocks;
 };
 }
@@ -5,12 +5,18 @@
 
 #include "libbirch/external.hpp"
 #include "libbirch/Atomic.hpp"
+#include "libbirch/Lock.hpp"
 
 namespace libbirch {
 /**
  * Lock allowing multiple readers but only one writer.
  *
  * @ingroup libbirch
+ *
+ * Readers take precedence: a writer that obtains the lock while there are
+ * readers releases it again and waits for them to finish. This permits a
+ * thread that already has read use to obtain it again. Waiting threads spin
+ * with backoff, then park (see wait.hpp).
  */
 class ReadersWriterLock {
 public:
@@ -24,7 +30,7 @@ public:
    */
   void bitwiseFix() {
     readers.store(0u);
-    writer.store(false);
+    writer.bitwiseFix();
   }
 
   /**
@@ -55,55 +61,54 @@ public:
 
 private:
   /**
-   * Number of readers in critical region.
+   * Number of readers in critical region, with the PARKED bit set if
+   * writers are parked waiting for them to finish.
    */
   Atomic<unsigned> readers;
 
   /**
-   * Is there a writer in the critical region?
+   * Lock held by the writer in the critical region.
    */
-  Atomic<bool> writer;
+  Lock writer;
 };
 }
 
 inline libbirch::ReadersWriterLock::ReadersWriterLock() :
-    readers(0),
-    writer(false) {
+    readers(0) {
   //
 }
 
 inline void libbirch::ReadersWriterLock::setRead() {
   readers.increment();
-  while (writer.load()) {
-    //
-  }
+  writer.wait();
 }
 
 inline void libbirch::ReadersWriterLock::unsetRead() {
-  readers.decrement();
+  decrement_wake(readers);
 }
 
 inline void libbirch::ReadersWriterLock::setWrite() {
-  bool w;
-  do {
+  while (true) {
     /* obtain the write lock */
-    while (writer.exchange(true));
+    writer.set();
 
     /* check if there are any readers; if so release the write lock to
-     * let those readers proceed and avoid a deadlock situation, repeating
-     * from the start, otherwise proceed */
-    w = (readers.load() == 0);
-    if (!w) {
-      writer.store(false);
+     * let those readers proceed and avoid a deadlock situation, waiting
+     * for them to finish before repeating from the start, otherwise
+     * proceed */
+    if ((readers.load() & ~PARKED) == 0u) {
+      return;
     }
-  } while (!w);
+    writer.unset();
+    wait_zero(readers);
+  }
 }
 
 inline void libbirch::ReadersWriterLock::unsetWrite() {
-  writer.store(false);
+  writer.unset();
 }
 
 inline void libbirch::ReadersWriterLock::downgrade() {
   readers.increment();
-  writer.store(false);
+  writer.unset();
 }
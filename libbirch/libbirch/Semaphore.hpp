@@ -35,7 +35,7 @@ public:
    */
   void bitwiseFix() {
     lock.bitwiseFix();
-    count.set(0u);
+    count.store(0u);
   }
 
   /**
@@ -43,7 +43,16 @@ public:
    */
   void acquire() {
     lock.set();
-    while (count.load() == 0u);
+    Backoff backoff;
+    unsigned c;
+    while (((c = count.load()) & ~PARKED) == 0u) {
+      if (!backoff.spin()) {
+        /* flag that there is a thread parked, so that release() wakes it */
+        if ((c & PARKED) || count.compareExchange(c, c | PARKED)) {
+          park(count, c | PARKED);
+        }
+      }
+    }
     --count;
     lock.unset();
   }
@@ -52,7 +61,7 @@ public:
    * Release. Increments the count by one.
    */
   void release() {
-    count.increment();
+    release(1u);
   }
 
   /**
@@ -60,7 +69,10 @@ public:
    */
   void release(unsigned n) {
     if (n > 0) {
-      count.add(n);
+      if ((count += n) & PARKED) {
+        count.maskAnd(~PARKED);
+        unpark_all(count);
+      }
     }
   }
 
@@ -71,7 +83,8 @@ private:
   Lock lock;
 
   /**
-   * Count.
+   * Count, with the PARKED bit set if a thread is parked waiting for it to
+   * become positive.
    */
   Atomic<unsigned> count;
 };
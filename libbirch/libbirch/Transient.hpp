@@ -0,0 +1,76 @@
+/**
+ * @file
+ */
+#pragma once
+
+#include "libbirch/Any.hpp"
+
+namespace libbirch {
+/**
+ * Object with automatic storage duration.
+ *
+ * @ingroup libbirch
+ *
+ * @tparam T Type, must derive from Any.
+ *
+ * This is for objects that live only as long as a single statement, such as
+ * the events of the `<~`, `~>` and `~` operators. The object is constructed
+ * in place, within the Transient, rather than allocated, and it is never
+ * registered as a possible root for cycle collection as pointers to it are
+ * copied and released.
+ *
+ * Pointers to the object may be made from get() and copied as for any other
+ * object, but must all be released before the Transient is destroyed. It is
+ * an error to retain one beyond that.
+ */
+template<class T>
+class Transient {
+public:
+  /**
+   * Constructor.
+   *
+   * @param args Constructor arguments.
+   */
+  template<class... Args>
+  explicit Transient(const Args&... args) {
+    auto o = ::new (static_cast<void*>(&buffer)) T(args...);
+    o->sharedCount.store(1u);  // released on destruction
+    o->flags.store(Any::BUFFERED);
+    // ^ so that it is never registered as a possible root, as it cannot be
+    //   the root of a cycle when nothing retains it
+  }
+
+  Transient(const Transient&) = delete;
+  Transient& operator=(const Transient&) = delete;
+
+  /**
+   * Destructor.
+   */
+  ~Transient() {
+    auto o = get();
+    libbirch_error_msg_(o->numShared() == 1u && o->numMemo() == 1u,
+        "object of class " << o->getClassName() <<
+        " retained beyond its scope");
+    o->sharedCount.store(0u);
+    #ifdef ENABLE_MEMORY_STATS
+    if (o->flags.load() & Any::COUNTED) {
+      stats_destroy(o);
+    }
+    #endif
+    o->~T();
+  }
+
+  /**
+   * Get the object.
+   */
+  T* get() {
+    return reinterpret_cast<T*>(&buffer);
+  }
+
+private:
+  /**
+   * Storage for the object.
+   */
+  std::aligned_storage_t<sizeof(T),alignof(T)> buffer;
+};
+}
@@ -9,9 +9,12 @@
 #include <numeric>
 #include <limits>
 #include <utility>
+#include <type_traits>
 #include <functional>
 #include <vector>
+#include <unordered_map>
 #include <memory>
+#include <atomic>
 #include <string>
 #include <sstream>
 #include <iomanip>
@@ -19,10 +22,14 @@
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cstdint>
 #include <cstddef>
+#include <climits>
 #include <cmath>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sched.h>
 #include <getopt.h>
 #include <dlfcn.h>
 
@@ -31,3 +38,12 @@
 #ifdef HAVE_OMP_H
 #include <omp.h>
 #endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
@@ -17,6 +17,7 @@
 #include "libbirch/Shared.hpp"
 #include "libbirch/Init.hpp"
 #include "libbirch/Lazy.hpp"
+#include "libbirch/Transient.hpp"
 #include "libbirch/Dimension.hpp"
 #include "libbirch/Index.hpp"
 #include "libbirch/Range.hpp"
@@ -373,54 +374,126 @@ auto optional_assign(const To& to, const Optional<From>& from) {
   }
 }
 
+/**
+ * Handler with direct handling, for simulate(), observe() and assume().
+ *
+ * @tparam Play Handler class with direct handling.
+ *
+ * @param handler Event handler, for which `isDirect()` is true, and which
+ * must therefore be of class Play, or a class derived from it.
+ *
+ * The handler is converted to the base class of Play first, so that this
+ * compiles for any handler class, whether or not derived from Play.
+ */
+template<class Play, class Handler>
+Play* direct(Handler* handler) {
+  using base_type = typename Play::super_type_;
+  auto base = static_cast<base_type*>(handler);
+  assert(dynamic_cast<Play*>(base));
+  return static_cast<Play*>(base);
+}
+
 /**
  * Simulate. Corresponds to the `<~` operator in Birch.
  *
+ * @tparam Event Event class template.
+ * @tparam Play Handler class with direct handling.
+ *
  * @param left Target.
- * @param event Event.
+ * @param p Distribution.
  * @param handler Event handler.
- */
-template<class Left, class Event, class Handler>
-auto simulate(Left& left, const Event& event, const Handler& handler) {
-  handler->handle(event);
-  left = event->value();
+ *
+ * Where the handler permits, the event is handled directly by a call to
+ * `Play::doSimulate()`, without constructing it. Otherwise it is
+ * constructed as a Transient, as handlers do not retain events; those that
+ * record to a trace make a separate Record of it.
+ */
+template<template<class> class Event, class Play, class Left,
+    template<class> class Distribution, class Value, class Handler>
+auto simulate(Left& left, const Lazy<Shared<Distribution<Value>>>& p,
+    const Handler& handler) {
+  auto h = handler.get();
+  if (h->isDirect()) {
+    left = direct<Play>(h)->template doSimulate<Value>(p);
+  } else {
+    Transient<Event<Value>> event(p, handler);
+    Lazy<Shared<Event<Value>>> e(event.get());
+    h->handle(e);
+    left = e->value();
+  }
   return left;
 }
 
 /**
  * Simulate. Corresponds to the `<~` operator in Birch.
  *
+ * @tparam Event Event class template.
+ * @tparam Play Handler class with direct handling.
+ *
  * @param left Target.
- * @param event Event.
+ * @param p Distribution.
  * @param handler Event handler.
  */
-template<class Left, class Event, class Handler>
-auto simulate(Left&& left, const Event& event, const Handler& handler) {
-  handler->handle(event);
-  left = event->value();
+template<template<class> class Event, class Play, class Left,
+    template<class> class Distribution, class Value, class Handler>
+auto simulate(Left&& left, const Lazy<Shared<Distribution<Value>>>& p,
+    const Handler& handler) {
+  auto h = handler.get();
+  if (h->isDirect()) {
+    left = direct<Play>(h)->template doSimulate<Value>(p);
+  } else {
+    Transient<Event<Value>> event(p, handler);
+    Lazy<Shared<Event<Value>>> e(event.get());
+    h->handle(e);
+    left = e->value();
+  }
   return left;
 }
 
 /**
- * Observe. Corresponds to the `<~` operator in Birch.
+ * Observe. Corresponds to the `~>` operator in Birch.
  *
- * @param event Event.
+ * @tparam Event Event class template.
+ * @tparam Play Handler class with direct handling.
+ *
+ * @param left Observed value.
+ * @param p Distribution.
  * @param handler Event handler.
  */
-template<class Event, class Handler>
-void observe(const Event& event, const Handler& handler) {
-  handler->handle(event);
+template<template<class> class Event, class Play, class Left,
+    template<class> class Distribution, class Value, class Handler>
+void observe(const Left& left, const Lazy<Shared<Distribution<Value>>>& p,
+    const Handler& handler) {
+  auto h = handler.get();
+  if (h->isDirect()) {
+    direct<Play>(h)->template doObserve<Value>(left, p);
+  } else {
+    Transient<Event<Value>> event(left, p, handler);
+    h->handle(Lazy<Shared<Event<Value>>>(event.get()));
+  }
 }
 
 /**
  * Assume. Corresponds to the `~` operator in Birch.
  *
- * @param event Event.
+ * @tparam Event Event class template.
+ * @tparam Play Handler class with direct handling.
+ *
+ * @param left Random variate.
+ * @param p Distribution.
  * @param handler Event handler.
  */
-template<class Event, class Handler>
-void assume(const Event& event, const Handler& handler) {
-  handler->handle(event);
+template<template<class> class Event, class Play, class Left,
+    template<class> class Distribution, class Value, class Handler>
+void assume(const Left& left, const Lazy<Shared<Distribution<Value>>>& p,
+    const Handler& handler) {
+  auto h = handler.get();
+  if (h->isDirect()) {
+    direct<Play>(h)->template doAssume<Value>(left, p);
+  } else {
+    Transient<Event<Value>> event(left, p, handler);
+    h->handle(Lazy<Shared<Event<Value>>>(event.get()));
+  }
 }
 
 /**
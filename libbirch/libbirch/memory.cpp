@@ -4,7 +4,9 @@
 #include "libbirch/memory.hpp"
 
 #include "libbirch/Atomic.hpp"
+#include "libbirch/Lock.hpp"
 #include "libbirch/Pool.hpp"
+#include "libbirch/wait.hpp"
 #include "libbirch/Any.hpp"
 #include "libbirch/Label.hpp"
 #include "libbirch/Shared.hpp"
@@ -14,13 +16,43 @@
  */
 using object_list = std::vector<libbirch::Any*,libbirch::Allocator<libbirch::Any*>>;
 
+/**
+ * Get the possible roots list for a thread.
+ */
+static object_list& get_possible_roots(const int tid) {
+  static std::vector<object_list,libbirch::Allocator<object_list>> objects(
+      libbirch::get_max_threads());
+  return objects[tid];
+}
+
 /**
  * Get the possible roots list for the current thread.
  */
 static object_list& get_thread_possible_roots() {
-  static std::vector<object_list,libbirch::Allocator<object_list>> objects(
+  return get_possible_roots(libbirch::get_thread_num());
+}
+
+/**
+ * Deferred visit.
+ */
+struct visit_item {
+  libbirch::Any* o;
+  libbirch::Label* label;
+  int op;
+};
+
+/**
+ * Type for lists of deferred visits.
+ */
+using visit_list = std::vector<visit_item,libbirch::Allocator<visit_item>>;
+
+/**
+ * Get the deferred visits list for the current thread.
+ */
+static visit_list& get_thread_visits() {
+  static std::vector<visit_list,libbirch::Allocator<visit_list>> visits(
       libbirch::get_max_threads());
-  return objects[libbirch::get_thread_num()];
+  return visits[libbirch::get_thread_num()];
 }
 
 /**
@@ -33,83 +65,273 @@ static object_list& get_thread_unreachable() {
 }
 
 /**
- * Make the heap.
+ * Make the root label.
  */
-static char* make_heap() {
-  #ifdef DISABLE_MEMORY_POOL
-  return nullptr;
-  #else
-  /* determine a preferred size of the heap based on total physical memory */
-  size_t size = sysconf(_SC_PAGE_SIZE);
-  size_t npages = sysconf(_SC_PHYS_PAGES);
-  size_t n = 8u*npages*size;
+static libbirch::Label* make_root() {
+  return new libbirch::Label();
+}
 
-  /* attempt to allocate this amount, successively halving until
-   * successful */
-  void* ptr = nullptr;
-  int res = 0;
-  do {
-    res = posix_memalign(&ptr, 64ull, n);
-    n >>= 1;
-  } while (res > 0 && n > 0u);
-  assert(ptr);
+libbirch::ExitBarrierLock libbirch::finish_lock;
+libbirch::ExitBarrierLock libbirch::freeze_lock;
 
-  return (char*)ptr;
+/**
+ * Size of a page.
+ */
+static size_t page_size() {
+  static size_t size = sysconf(_SC_PAGE_SIZE);
+  return size;
+}
+
+/**
+ * Round a number of bytes up to a whole number of pages.
+ */
+static size_t round_pages(const size_t n) {
+  auto size = page_size();
+  return ((n + size - 1u)/size)*size;
+}
+
+#ifndef DISABLE_MEMORY_POOL
+/**
+ * Map memory from the operating system.
+ *
+ * @param n Number of bytes, a whole number of pages.
+ */
+static void* map(const size_t n) {
+  void* ptr = mmap(nullptr, n, PROT_READ|PROT_WRITE,
+      MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  libbirch_error_msg_(ptr != MAP_FAILED, "out of memory");
+  return ptr;
+}
+
+/**
+ * Map a new chunk from the operating system. Address space is reserved for
+ * one chunk at a time, with physical memory committed by the operating
+ * system as pages are first touched.
+ */
+static libbirch::Chunk* map_chunk() {
+  /* map twice the size of a chunk and trim to obtain one that is aligned
+   * to its size */
+  const size_t size = libbirch::Chunk::size;
+  auto ptr = static_cast<char*>(map(2u*size));
+  auto first = reinterpret_cast<char*>(
+      (reinterpret_cast<uintptr_t>(ptr) + size - 1u) & ~(uintptr_t(size) - 1u));
+  auto last = first + size;
+  if (first > ptr) {
+    munmap(ptr, first - ptr);
+  }
+  if (ptr + 2u*size > last) {
+    munmap(last, ptr + 2u*size - last);
+  }
+  #if defined(ENABLE_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+  madvise(first, size, MADV_HUGEPAGE);
   #endif
+  return reinterpret_cast<libbirch::Chunk*>(first);
 }
+#endif
 
 /**
- * Make the root label.
+ * Make an array of cache-line aligned objects, such as those used per
+ * thread, to avoid false sharing between threads. Operator new[] does not
+ * guarantee the alignment prior to C++17.
+ *
+ * @param n Number of objects.
  */
-static libbirch::Label* make_root() {
-  return new libbirch::Label();
+template<class T>
+static T* make_aligned(const int n) {
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, alignof(T), n*sizeof(T)) != 0) {
+    ptr = nullptr;
+  }
+  assert(ptr);
+  auto objects = static_cast<T*>(ptr);
+  for (int i = 0; i < n; ++i) {
+    new (objects + i) T();
+  }
+  return objects;
 }
 
-libbirch::ExitBarrierLock libbirch::finish_lock;
-libbirch::ExitBarrierLock libbirch::freeze_lock;
+#ifndef DISABLE_MEMORY_POOL
+/**
+ * Chunks that have been released by a thread, and are available for reuse
+ * by it.
+ */
+struct alignas(64) spare_chunks {
+  libbirch::Chunk* first = nullptr;
+};
 
 /**
- * Get the heap.
+ * Get the spare chunks for the current thread.
  */
-inline libbirch::Atomic<char*>& heap() {
-  static libbirch::Atomic<char*> heap(make_heap());
-  return heap;
+static spare_chunks& get_thread_spare_chunks() {
+  static spare_chunks* spares = make_aligned<spare_chunks>(
+      libbirch::get_max_threads());
+  return spares[libbirch::get_thread_num()];
 }
+#endif
 
 /**
- * Get the `i`th pool.
+ * Growth of the heap by a thread since the last full collection, used to
+ * trigger collections. Each thread updates only its own, without
+ * synchronization.
  */
-inline libbirch::Pool& pool(const int i) {
-  static libbirch::Pool* pools =
-      new libbirch::Pool[64*libbirch::get_max_threads()];
-  return pools[i];
+struct alignas(64) heap_growth {
+  size_t bytes = 0u;
+};
+
+/**
+ * Get the heap growth for a thread.
+ */
+static heap_growth& get_heap_growth(const int tid) {
+  static heap_growth* growth = make_aligned<heap_growth>(
+      libbirch::get_max_threads());
+  return growth[tid];
 }
 
 /**
- * For an allocation size, determine the index of the pool to which it
- * belongs.
+ * Record growth of the heap by the current thread.
  *
  * @param n Number of bytes.
+ */
+static void grow(const size_t n) {
+  get_heap_growth(libbirch::get_thread_num()).bytes += n;
+}
+
+#ifndef DISABLE_MEMORY_POOL
+/**
+ * Acquire a chunk for the current thread, reusing a spare chunk if
+ * possible, otherwise mapping a new one.
  *
- * @return Pool index.
+ * @param bin Size class of blocks.
+ * @param blockSize Size of blocks, in bytes.
+ */
+static libbirch::Chunk* acquire_chunk(const int bin, const size_t blockSize) {
+  auto& spares = get_thread_spare_chunks();
+  auto chunk = spares.first;
+  if (chunk) {
+    spares.first = chunk->next;
+  } else {
+    chunk = map_chunk();
+  }
+  chunk->init(bin, blockSize, libbirch::get_thread_num());
+  grow(libbirch::Chunk::size);
+  return chunk;
+}
+
+/**
+ * Release an empty chunk of the current thread. Its physical memory, other
+ * than the page containing its header, is returned to the operating system,
+ * while its address space is retained as a spare chunk for reuse.
+ */
+static void release_chunk(libbirch::Chunk* chunk) {
+  assert(chunk->empty());
+  auto& spares = get_thread_spare_chunks();
+  madvise(reinterpret_cast<char*>(chunk) + page_size(),
+      libbirch::Chunk::size - page_size(), MADV_DONTNEED);
+  chunk->next = spares.first;
+  spares.first = chunk;
+}
+#endif
+
+/**
+ * Number of pools per thread, one for each size class up to 256 KiB.
+ * Allocations in larger size classes are not pooled, but mapped
+ * individually from the operating system.
+ */
+static const int NPOOLS = 52;
+
+/**
+ * Get the pool for a given thread and bin.
+ */
+inline libbirch::Pool& pool(const int tid, const int i) {
+  static libbirch::Pool* pools = make_aligned<libbirch::Pool>(
+      NPOOLS*libbirch::get_max_threads());
+  return pools[NPOOLS*tid + i];
+}
+
+#ifndef NDEBUG
+/**
+ * Flag, for each thread number, set while its pools are in use.
+ */
+struct alignas(64) pool_flag {
+  libbirch::Atomic<int> busy;
+};
+
+/**
+ * Check, in debug builds, that the pools of a thread number are used by only
+ * one thread at a time, for the lifetime of the guard.
  *
- * Pool sizes are multiples of 8 bytes up to 64 bytes, and powers of two
- * thereafter.
+ * Pools, and the spare chunks of each thread, are indexed by
+ * get_thread_num(), and are unsynchronized. This assumes that each thread
+ * number is held by only one operating system thread at a time, which holds
+ * for a single level of OpenMP parallelism, but not for nested parallel
+ * regions, where each team numbers its threads from zero, nor for threads
+ * created outside of OpenMP.
  */
-inline int bin(const size_t n) {
+class pool_guard {
+public:
+  pool_guard(const int tid) : flag(flags()[tid]) {
+    auto busy = flag.busy.exchange(1);
+    assert(busy == 0 && "thread number in use by more than one thread");
+  }
+
+  ~pool_guard() {
+    flag.busy.store(0);
+  }
+
+private:
+  static pool_flag* flags() {
+    static pool_flag* flags = make_aligned<pool_flag>(
+        libbirch::get_max_threads());
+    return flags;
+  }
+
+  pool_flag& flag;
+};
+#endif
+
+/**
+ * Floor of the base-two logarithm of a positive number.
+ */
+inline int log2_floor(const size_t n) {
   assert(n > 0ull);
-  int result = 0;
   #ifdef HAVE___BUILTIN_CLZLL
-  if (n > 64ull) {
-    /* __builtin_clzll undefined for zero argument */
-    result = 64 - __builtin_clzll((n - 1ull) >> 6ull);
-  }
+  return 63 - __builtin_clzll(n);
   #else
-  while (((n - 1ull) >> (6 + result)) > 0) {
+  int result = 0;
+  while ((n >> (result + 1)) > 0) {
     ++result;
   }
+  return result;
   #endif
-  assert(0 <= result && result <= 63);
+}
+
+/**
+ * For an allocation size, determine the index of the size class, and so
+ * pool, to which it belongs.
+ *
+ * @param n Number of bytes.
+ *
+ * @return Pool index.
+ *
+ * Size classes are 16, 32 and 48 bytes, then 64 bytes, then four per
+ * doubling thereafter: 80, 96, 112 and 128 bytes; 160, 192, 224 and 256
+ * bytes; and so on. Rounding an allocation up to its size class therefore
+ * wastes at most 20% of the block beyond 64 bytes, rather than almost half
+ * as for power-of-two sizes.
+ */
+inline int bin(const size_t n) {
+  assert(n > 0ull);
+  int result;
+  if (n <= 48ull) {
+    result = int((n - 1ull) >> 4ull);
+  } else if (n <= 64ull) {
+    result = 3;
+  } else {
+    int e = log2_floor(n - 1ull);  // power of two for the group, at least 6
+    int j = int(((n - 1ull) >> (e - 2)) & 3ull);  // position in the group
+    result = 4 + 4*(e - 6) + j;
+  }
+  assert(0 <= result && result <= 235);
   return result;
 }
 
@@ -117,7 +339,22 @@ inline int bin(const size_t n) {
  * Determine the size for a given bin.
  */
 inline size_t unbin(const int i) {
-  return 64ull << i;
+  if (i < 3) {
+    return 16ull*(i + 1);
+  } else if (i == 3) {
+    return 64ull;
+  } else {
+    int e = 6 + (i - 4)/4;
+    int j = (i - 4) % 4;
+    return (1ull << e) + (j + 1ull)*(1ull << (e - 2));
+  }
+}
+
+/**
+ * Is an allocation in a given bin too large to be pooled?
+ */
+inline bool is_large(const int i) {
+  return i >= NPOOLS;
 }
 
 libbirch::Label*& libbirch::root() {
@@ -125,34 +362,183 @@ libbirch::Label*& libbirch::root() {
   return root;
 }
 
+/**
+ * Number of bytes reserved for an allocation.
+ *
+ * @param i Bin.
+ * @param n Number of bytes requested.
+ */
+inline size_t reserved(const int i, const size_t n) {
+  return is_large(i) ? round_pages(n) : unbin(i);
+}
+
+#ifdef ENABLE_MEMORY_STATS
+/**
+ * Number of bins for which statistics are kept, enough for any allocation.
+ */
+static const int NBINS = 236;
+
+/**
+ * Memory statistics for a bin.
+ */
+struct bin_stats {
+  size_t nallocs = 0u;
+  size_t nfrees = 0u;
+  size_t requested = 0u;
+  size_t allocated = 0u;
+  size_t freed = 0u;
+};
+
+/**
+ * Memory statistics for a class of object.
+ */
+struct class_stats {
+  size_t ncreated = 0u;
+  size_t ndestroyed = 0u;
+  size_t created = 0u;
+  size_t destroyed = 0u;
+};
+
+/**
+ * Memory statistics for a thread. Each thread updates only its own, without
+ * synchronization.
+ */
+struct alignas(64) thread_stats {
+  bin_stats bins[NBINS];
+  std::unordered_map<const char*,class_stats> classes;
+  // ^ uses the default allocator, as this is updated within allocate()
+  int64_t live = 0;
+  int64_t peak = 0;
+};
+
+/**
+ * Get the memory statistics for a thread.
+ */
+static thread_stats& get_thread_stats(const int tid) {
+  static thread_stats* stats = make_aligned<thread_stats>(
+      libbirch::get_max_threads());
+  return stats[tid];
+}
+
+/**
+ * Bytes in use over all threads.
+ */
+static libbirch::Atomic<int64_t> live_bytes(0);
+
+/**
+ * High-water mark of bytes in use over all threads.
+ */
+static libbirch::Atomic<int64_t> peak_bytes(0);
+
+/**
+ * Record an allocation.
+ *
+ * @param i Bin.
+ * @param n Number of bytes requested.
+ */
+static void stats_allocate(const int i, const size_t n) {
+  auto m = reserved(i, n);
+  auto& stats = get_thread_stats(libbirch::get_thread_num());
+  auto& bin = stats.bins[i];
+  ++bin.nallocs;
+  bin.requested += n;
+  bin.allocated += m;
+  stats.live += m;
+  stats.peak = std::max(stats.peak, stats.live);
+
+  auto live = (live_bytes += m);
+  auto peak = peak_bytes.load();
+  while (live > peak && !peak_bytes.compareExchange(peak, live));
+}
+
+/**
+ * Record a deallocation.
+ *
+ * @param i Bin.
+ * @param n Number of bytes requested.
+ */
+static void stats_deallocate(const int i, const size_t n) {
+  auto m = reserved(i, n);
+  auto& stats = get_thread_stats(libbirch::get_thread_num());
+  auto& bin = stats.bins[i];
+  ++bin.nfrees;
+  bin.freed += m;
+  stats.live -= m;
+  live_bytes.subtract(m);
+}
+#endif
+
 void* libbirch::allocate(const size_t n) {
   assert(n > 0u);
 
+  #ifdef ENABLE_MEMORY_STATS
+  stats_allocate(bin(n), n);
+  #endif
+
   #ifdef DISABLE_MEMORY_POOL
+  grow(n);
   return std::malloc(n);
   #else
-  int tid = get_thread_num();
   int i = bin(n);       // determine which pool
-  auto ptr = pool(64*tid + i).pop();  // attempt to reuse from this pool
-  if (!ptr) {           // otherwise allocate new
-    size_t m = unbin(i);
-    ptr = (heap() += m) - m;
+  if (is_large(i)) {    // map large allocations individually
+    grow(round_pages(n));
+    return map(round_pages(n));
+  }
+  int tid = get_thread_num();
+  #ifndef NDEBUG
+  pool_guard guard(tid);
+  #endif
+  auto& p = pool(tid, i);
+  auto ptr = p.pop();   // attempt to reuse from this pool
+  if (!ptr) {           // otherwise allocate from a new chunk
+    p.add(acquire_chunk(i, unbin(i)));
+    ptr = p.pop();
   }
   assert(ptr);
   return ptr;
   #endif
 }
 
+size_t libbirch::round_allocation(const size_t n) {
+  assert(n > 0u);
+  int i = bin(n);
+  return is_large(i) ? round_pages(unbin(i)) : unbin(i);
+}
+
 void libbirch::deallocate(void* ptr, const size_t n, const int tid) {
   assert(ptr);
   assert(n > 0u);
   assert(tid < get_max_threads());
 
+  #ifdef ENABLE_MEMORY_STATS
+  stats_deallocate(bin(n), n);
+  #endif
+
   #ifdef DISABLE_MEMORY_POOL
   std::free(ptr);
   #else
   int i = bin(n);
-  pool(64*tid + i).push(ptr);
+  if (is_large(i)) {
+    munmap(ptr, round_pages(n));
+  } else {
+    /* the owning thread is that of the chunk, which need not be the thread
+     * that allocated, e.g. for libbirch::Allocator */
+    auto chunk = Chunk::of(ptr);
+    assert(chunk->bin == i);
+    if (chunk->tid == get_thread_num()) {
+      /* fast path, return to this thread's own pool */
+      #ifndef NDEBUG
+      pool_guard guard(chunk->tid);
+      #endif
+      auto empty = pool(chunk->tid, i).push(ptr);
+      if (empty) {
+        release_chunk(empty);
+      }
+    } else {
+      /* slow path, return to the remote stack of the other thread's pool */
+      pool(chunk->tid, i).pushRemote(ptr);
+    }
+  }
   #endif
 }
 
@@ -164,12 +550,41 @@ void* libbirch::reallocate(void* ptr1, const size_t n1, const int tid1,
   assert(n2 > 0u);
 
   #ifdef DISABLE_MEMORY_POOL
+  #ifdef ENABLE_MEMORY_STATS
+  stats_deallocate(bin(n1), n1);
+  stats_allocate(bin(n2), n2);
+  #endif
+  if (n2 > n1) {
+    grow(n2 - n1);
+  }
   return std::realloc(ptr1, n2);
   #else
   int i1 = bin(n1);
   int i2 = bin(n2);
   void* ptr2 = ptr1;
-  if (i1 != i2) {
+  if (i1 == i2 || (is_large(i1) && is_large(i2))) {
+    #ifdef ENABLE_MEMORY_STATS
+    stats_deallocate(i1, n1);
+    stats_allocate(i2, n2);
+    #endif
+  }
+  if (is_large(i1) && is_large(i2)) {
+    auto m1 = round_pages(n1);
+    auto m2 = round_pages(n2);
+    if (m1 != m2) {
+      if (m2 > m1) {
+        grow(m2 - m1);
+      }
+      #ifdef MREMAP_MAYMOVE
+      ptr2 = mremap(ptr1, m1, m2, MREMAP_MAYMOVE);
+      libbirch_error_msg_(ptr2 != MAP_FAILED, "out of memory");
+      #else
+      ptr2 = map(m2);
+      std::memcpy(ptr2, ptr1, std::min(n1, n2));
+      munmap(ptr1, m1);
+      #endif
+    }
+  } else if (i1 != i2) {
     /* can't continue using current allocation */
     ptr2 = allocate(n2);
     if (ptr1 && ptr2) {
@@ -181,6 +596,202 @@ void* libbirch::reallocate(void* ptr1, const size_t n1, const int tid1,
   #endif
 }
 
+void libbirch::print_occupancy() {
+  #ifndef DISABLE_MEMORY_POOL
+  printf("%10s %8s %12s %16s %9s\n", "size", "chunks", "blocks", "bytes",
+      "occupancy");
+  for (int i = 0; i < NPOOLS; ++i) {
+    size_t nchunks = 0u, nblocks = 0u;
+    for (int tid = 0; tid < get_max_threads(); ++tid) {
+      nchunks += pool(tid, i).numChunks();
+      nblocks += pool(tid, i).numBlocks();
+    }
+    if (nchunks > 0u) {
+      auto size = unbin(i);
+      auto capacity = nchunks*((Chunk::size - sizeof(Chunk))/size);
+      printf("%10zu %8zu %12zu %16zu %8.1f%%\n", size, nchunks, nblocks,
+          nblocks*size, 100.0*nblocks/capacity);
+    }
+  }
+  #endif
+}
+
+std::string libbirch::memory_stats() {
+  std::stringstream buf;
+  buf << "{\n";
+
+  #ifdef ENABLE_MEMORY_STATS
+  buf << "  \"enabled\": true,\n";
+  buf << "  \"live\": " << live_bytes.load() << ",\n";
+  buf << "  \"peak\": " << peak_bytes.load() << ",\n";
+  #else
+  buf << "  \"enabled\": false,\n";
+  #endif
+
+  /* per size class */
+  buf << "  \"bins\": [";
+  bool first = true;
+  #ifdef ENABLE_MEMORY_STATS
+  for (int i = 0; i < NBINS; ++i) {
+  #else
+  for (int i = 0; i < NPOOLS; ++i) {
+  #endif
+    size_t nchunks = 0u, nblocks = 0u;
+    #ifndef DISABLE_MEMORY_POOL
+    if (!is_large(i)) {
+      for (int tid = 0; tid < get_max_threads(); ++tid) {
+        nchunks += pool(tid, i).numChunks();
+        nblocks += pool(tid, i).numBlocks();
+      }
+    }
+    #endif
+    auto size = unbin(i);
+    auto capacity = nchunks*((Chunk::size - sizeof(Chunk))/size);
+    #ifdef ENABLE_MEMORY_STATS
+    bin_stats total;
+    for (int tid = 0; tid < get_max_threads(); ++tid) {
+      auto& stats = get_thread_stats(tid).bins[i];
+      total.nallocs += stats.nallocs;
+      total.nfrees += stats.nfrees;
+      total.requested += stats.requested;
+      total.allocated += stats.allocated;
+      total.freed += stats.freed;
+    }
+    if (nchunks > 0u || total.nallocs > 0u) {
+    #else
+    if (nchunks > 0u) {
+    #endif
+      buf << (first ? "\n" : ",\n");
+      buf << "    {\n";
+      buf << "      \"size\": " << size << ",\n";
+      #ifdef ENABLE_MEMORY_STATS
+      buf << "      \"allocs\": " << total.nallocs << ",\n";
+      buf << "      \"frees\": " << total.nfrees << ",\n";
+      buf << "      \"requested\": " << total.requested << ",\n";
+      buf << "      \"allocated\": " << total.allocated << ",\n";
+      buf << "      \"freed\": " << total.freed << ",\n";
+      buf << "      \"live\": " << (total.allocated - total.freed) << ",\n";
+      #endif
+      buf << "      \"chunks\": " << nchunks << ",\n";
+      buf << "      \"blocks\": " << nblocks << ",\n";
+      buf << "      \"pooled\": " << (capacity - nblocks)*size << "\n";
+      buf << "    }";
+      first = false;
+    }
+  }
+  buf << (first ? "]" : "\n  ]");
+
+  #ifdef ENABLE_MEMORY_STATS
+  /* per thread */
+  buf << ",\n  \"threads\": [";
+  for (int tid = 0; tid < get_max_threads(); ++tid) {
+    auto& stats = get_thread_stats(tid);
+    bin_stats total;
+    for (int i = 0; i < NBINS; ++i) {
+      total.nallocs += stats.bins[i].nallocs;
+      total.nfrees += stats.bins[i].nfrees;
+      total.allocated += stats.bins[i].allocated;
+      total.freed += stats.bins[i].freed;
+    }
+    buf << (tid == 0 ? "\n" : ",\n");
+    buf << "    {\n";
+    buf << "      \"thread\": " << tid << ",\n";
+    buf << "      \"allocs\": " << total.nallocs << ",\n";
+    buf << "      \"frees\": " << total.nfrees << ",\n";
+    buf << "      \"allocated\": " << total.allocated << ",\n";
+    buf << "      \"freed\": " << total.freed << ",\n";
+    buf << "      \"live\": " << stats.live << ",\n";
+    buf << "      \"peak\": " << stats.peak << "\n";
+    buf << "    }";
+  }
+  buf << "\n  ]";
+
+  /* per class, merged across threads by name, as the same name may have a
+   * different address in different translation units, and sorted by bytes
+   * in use */
+  std::unordered_map<std::string,class_stats> merged;
+  for (int tid = 0; tid < get_max_threads(); ++tid) {
+    for (auto& entry : get_thread_stats(tid).classes) {
+      auto& total = merged[entry.first];
+      total.ncreated += entry.second.ncreated;
+      total.ndestroyed += entry.second.ndestroyed;
+      total.created += entry.second.created;
+      total.destroyed += entry.second.destroyed;
+    }
+  }
+  std::vector<std::pair<std::string,class_stats>> classes(merged.begin(),
+      merged.end());
+  std::sort(classes.begin(), classes.end(), [](const auto& a, const auto& b) {
+        return a.second.created - a.second.destroyed >
+            b.second.created - b.second.destroyed;
+      });
+  buf << ",\n  \"classes\": [";
+  first = true;
+  for (auto& entry : classes) {
+    auto& stats = entry.second;
+    buf << (first ? "\n" : ",\n");
+    buf << "    {\n";
+    buf << "      \"name\": \"" << entry.first << "\",\n";
+    buf << "      \"created\": " << stats.ncreated << ",\n";
+    buf << "      \"destroyed\": " << stats.ndestroyed << ",\n";
+    buf << "      \"live\": " << (stats.ncreated - stats.ndestroyed) << ",\n";
+    buf << "      \"bytes\": " << (stats.created - stats.destroyed) << "\n";
+    buf << "    }";
+    first = false;
+  }
+  buf << (first ? "]" : "\n  ]");
+  #endif
+
+  buf << "\n}\n";
+  return buf.str();
+}
+
+void libbirch::stats_create(Any* o) {
+  #ifdef ENABLE_MEMORY_STATS
+  auto& stats = get_thread_stats(get_thread_num()).classes[o->getClassName()];
+  ++stats.ncreated;
+  stats.created += o->size_();
+  #endif
+}
+
+void libbirch::stats_destroy(Any* o) {
+  #ifdef ENABLE_MEMORY_STATS
+  auto& stats = get_thread_stats(get_thread_num()).classes[o->getClassName()];
+  ++stats.ndestroyed;
+  stats.destroyed += o->size_();
+  #endif
+}
+
+libbirch::read_epoch* libbirch::get_read_epochs() {
+  static read_epoch* epochs = make_aligned<read_epoch>(get_max_threads());
+  return epochs;
+}
+
+void libbirch::synchronize_reads() {
+  /* a thread within a critical region at this point may have loaded the
+   * old data; wait for it to move on, but not for it to go quiet, as it may
+   * immediately enter another, in which case it will load the new data */
+  auto tid = get_thread_num();
+  auto nthreads = get_max_threads();
+  for (int i = 0; i < nthreads; ++i) {
+    if (i != tid) {
+      auto& epoch = get_read_epochs()[i];
+      auto count = epoch.count.load();
+      if (count % 2u == 1u) {
+        /* readers do not wake waiting threads on leaving a critical region,
+         * so once the budget for spinning is exhausted, yield rather than
+         * park */
+        Backoff backoff;
+        while (epoch.count.load() == count) {
+          if (!backoff.spin()) {
+            sched_yield();
+          }
+        }
+      }
+    }
+  }
+}
+
 void libbirch::register_possible_root(Any* o) {
   assert(o);
   o->incMemo();
@@ -196,51 +807,365 @@ void libbirch::register_unreachable(Any* o) {
   get_thread_unreachable().emplace_back(o);
 }
 
-void libbirch::collect() {
-  #pragma omp parallel num_threads(get_max_threads())
+void libbirch::defer_visit(Any* o, const int op, Label* label) {
+  get_thread_visits().push_back({o, label, op});
+}
+
+/**
+ * Range of a thread's list of objects, from which any thread may claim
+ * batches of objects to process during cycle collection.
+ */
+struct alignas(64) object_range {
+  libbirch::Any** first = nullptr;
+  libbirch::Any** last = nullptr;
+  libbirch::Atomic<size_t> next;
+};
+
+/**
+ * Get the range for a thread.
+ */
+static object_range& get_range(const int tid) {
+  static object_range* ranges = make_aligned<object_range>(
+      libbirch::get_max_threads());
+  return ranges[tid];
+}
+
+/**
+ * Number of objects claimed from a range at once.
+ */
+static const size_t BATCH_SIZE = 64u;
+
+/**
+ * Number of deferred visits shared with idle threads at once.
+ */
+static const size_t SHARE_SIZE = 256u;
+
+/**
+ * Lists of deferred visits shared by busy threads, for idle threads to take.
+ */
+static std::vector<visit_list,libbirch::Allocator<visit_list>>&
+    get_shared_visits() {
+  static std::vector<visit_list,libbirch::Allocator<visit_list>> visits;
+  return visits;
+}
+
+/**
+ * Lock for the shared lists of deferred visits.
+ */
+static libbirch::Lock shared_visits_lock;
+
+/**
+ * Number of shared lists of deferred visits.
+ */
+static libbirch::Atomic<int> nshared(0);
+
+/**
+ * Number of threads that are idle in the current phase of cycle collection.
+ */
+static libbirch::Atomic<int> nidle(0);
+
+/**
+ * Share deferred visits from the top of a thread's list.
+ */
+static void share(visit_list& visits) {
+  auto first = visits.end() - SHARE_SIZE;
+  visit_list shared(first, visits.end());
+  visits.erase(first, visits.end());
+  shared_visits_lock.set();
+  get_shared_visits().push_back(std::move(shared));
+  nshared.increment();
+  shared_visits_lock.unset();
+}
+
+/**
+ * Take shared deferred visits into a thread's list, which must be empty.
+ *
+ * @return Were any taken?
+ */
+static bool take(visit_list& visits) {
+  bool taken = false;
+  if (nshared.load() > 0) {
+    shared_visits_lock.set();
+    auto& shared = get_shared_visits();
+    if (!shared.empty()) {
+      visits.swap(shared.back());
+      shared.pop_back();
+      nshared.decrement();
+      taken = true;
+    }
+    shared_visits_lock.unset();
+  }
+  return taken;
+}
+
+/**
+ * Make the deferred visits in a thread's list, and any further visits that
+ * these defer, until the list is empty. While the list is long, and other
+ * threads are idle, some visits are shared with them.
+ */
+static void visit(visit_list& visits) {
+  while (!visits.empty()) {
+    auto next = visits.back();
+    visits.pop_back();
+    next.o->visit(next.op, next.label);
+    if (visits.size() >= 2u*SHARE_SIZE && nshared.load() < nidle.load()) {
+      share(visits);
+    }
+  }
+}
+
+/**
+ * Take and make visits shared by other threads until all threads are idle.
+ * This must be called by all threads of a parallel region, once they have
+ * no visits of their own remaining.
+ */
+static void balance() {
+  auto nthreads = libbirch::get_max_threads();
+  auto& visits = get_thread_visits();
+
+  /* a thread only shares while not idle, and checks for shared visits again
+   * before finishing, so once there are no shared visits and all threads
+   * are idle, all visits have been made */
+  nidle.increment();
+  libbirch::Backoff backoff;
+  while (true) {
+    if (nshared.load() > 0) {
+      nidle.decrement();
+      if (take(visits)) {
+        visit(visits);
+      }
+      nidle.increment();
+      backoff = libbirch::Backoff();
+    } else if (nidle.load() == nthreads) {
+      break;
+    } else if (!backoff.spin()) {
+      /* threads do not wake idle threads on sharing visits or becoming
+       * idle, so once the budget for spinning is exhausted, yield rather
+       * than park */
+      sched_yield();
+    }
+  }
+
+  /* reset for next time */
+  #pragma omp barrier
+  #pragma omp single
   {
-    /* mark */
-    auto& possible_roots = get_thread_possible_roots();
-    for (auto& o : possible_roots) {
-      if (o) {
-        if (o->isPossibleRoot()) {
-          o->mark();
-        } else {
-          o->decMemo();
-          o = nullptr;
-        }
+    nidle.store(0);
+    for (int i = 0; i < nthreads; ++i) {
+      get_range(i).next.store(0u);
+    }
+  }
+}
+
+/**
+ * Run one phase of the cycle collector. This must be called by all threads
+ * of a parallel region, after each has set its range.
+ *
+ * @param f Operation to apply to each object in the ranges. It may defer
+ * visits to further objects.
+ *
+ * Threads claim batches of objects from their own range, then from those of
+ * other threads, making deferred visits after each batch. Once all objects
+ * are claimed, idle threads take visits shared by busy threads, until all
+ * threads are idle.
+ */
+template<class F>
+static void traverse(F f) {
+  auto nthreads = libbirch::get_max_threads();
+  auto tid = libbirch::get_thread_num();
+  auto& visits = get_thread_visits();
+
+  /* objects in ranges */
+  for (int i = 0; i < nthreads; ++i) {
+    auto& range = get_range((tid + i) % nthreads);
+    auto size = size_t(range.last - range.first);
+    auto start = (range.next += BATCH_SIZE) - BATCH_SIZE;
+    while (start < size) {
+      auto end = std::min(start + BATCH_SIZE, size);
+      for (auto iter = range.first + start; iter != range.first + end;
+          ++iter) {
+        f(*iter);
       }
+      visit(visits);
+      start = (range.next += BATCH_SIZE) - BATCH_SIZE;
     }
-    #pragma omp barrier
+  }
+
+  balance();
+}
+
+/**
+ * Number of deferred visits of a thread above which visit_deferred(), called
+ * outside of a parallel region, shares them with other threads.
+ */
+static const size_t SPLIT_SIZE = 4u*SHARE_SIZE;
 
-    /* scan */
-    for (auto& o : possible_roots) {
-      if (o) {
-        o->scan();
+void libbirch::visit_deferred() {
+  auto& visits = get_thread_visits();
+  if (get_max_threads() > 1 && !in_parallel()) {
+    while (!visits.empty() && visits.size() < SPLIT_SIZE) {
+      auto next = visits.back();
+      visits.pop_back();
+      next.o->visit(next.op, next.label);
+    }
+    if (!visits.empty()) {
+      #pragma omp parallel num_threads(get_max_threads())
+      {
+        visit(get_thread_visits());
+        balance();
       }
     }
-    #pragma omp barrier
+  } else {
+    visit(visits);
+  }
+}
 
-    /* collect */
-    for (auto& o : possible_roots) {
-      if (o) {
-        o->collect();
+void libbirch::visit_deferred(const size_t n) {
+  auto& visits = get_thread_visits();
+  while (visits.size() > n) {
+    auto next = visits.back();
+    visits.pop_back();
+    next.o->visit(next.op, next.label);
+  }
+}
+
+size_t libbirch::num_deferred() {
+  return get_thread_visits().size();
+}
+
+/**
+ * Set the range for the current thread.
+ */
+static void set_range(libbirch::Any** first, libbirch::Any** last) {
+  auto& range = get_range(libbirch::get_thread_num());
+  range.first = first;
+  range.last = last;
+  range.next.store(0u);
+}
+
+/**
+ * Run the cycle collector on a range of possible roots of each thread. This
+ * must be called by all threads of a parallel region, each with its own
+ * range, which is processed and then cleared to null pointers. The ranges
+ * must not be modified until this returns, as other threads may process
+ * them.
+ *
+ * @param first Start of the range.
+ * @param last End of the range.
+ */
+static void collect_range(libbirch::Any** first, libbirch::Any** last) {
+  set_range(first, last);
+  #pragma omp barrier
+
+  /* mark */
+  traverse([](libbirch::Any*& o) {
+    if (o) {
+      if (o->isPossibleRoot()) {
+        o->mark();
+      } else {
         o->decMemo();
         o = nullptr;
       }
     }
-    possible_roots.clear();
-    #pragma omp barrier
-
-    /* destroy the objects indicated during collect */
-    auto& unreachable = get_thread_unreachable();
-    for (auto& o : unreachable) {
-      o->destroy();
-      o->decMemo();  // removes last memo count
+  });
+
+  /* scan */
+  traverse([](libbirch::Any*& o) {
+    if (o) {
+      o->scan();
+    }
+  });
+
+  /* collect */
+  traverse([](libbirch::Any*& o) {
+    if (o) {
+      o->collect();
+      o->decMemo();
+      o = nullptr;
+    }
+  });
+
+  /* destroy the objects indicated during collect; this may register
+   * further possible roots, but not further unreachable objects */
+  auto& unreachable = get_thread_unreachable();
+  set_range(unreachable.data(), unreachable.data() + unreachable.size());
+  #pragma omp barrier
+  traverse([](libbirch::Any*& o) {
+    o->destroy();
+    o->decMemo();  // removes last memo count
+  });
+  unreachable.clear();
+}
+
+/**
+ * Collection policy; see collect_if_due().
+ */
+static size_t collect_roots = 1u << 15u;
+static size_t collect_bytes = 64u << 20u;
+static size_t collect_slice = 1u << 13u;
+
+void libbirch::collect() {
+  #pragma omp parallel num_threads(get_max_threads())
+  {
+    /* objects destroyed may register further possible roots, appended to
+     * the list, so only the original range is erased afterward */
+    auto& possible_roots = get_thread_possible_roots();
+    auto k = possible_roots.size();
+    collect_range(possible_roots.data(), possible_roots.data() + k);
+    possible_roots.erase(possible_roots.begin(), possible_roots.begin() + k);
+    get_heap_growth(get_thread_num()).bytes = 0u;
+  }
+}
+
+void libbirch::collect(const size_t n) {
+  size_t total = 0u;
+  for (int tid = 0; tid < get_max_threads(); ++tid) {
+    total += get_possible_roots(tid).size();
+  }
+  if (n >= total) {
+    collect();
+  } else {
+    #pragma omp parallel num_threads(get_max_threads())
+    {
+      /* each thread contributes to the slice in proportion to the length of
+       * its list, from the front, where the oldest possible roots are */
+      auto& possible_roots = get_thread_possible_roots();
+      auto size = possible_roots.size();
+      auto k = std::min(size, (size*n + total - 1u)/total);
+      collect_range(possible_roots.data(), possible_roots.data() + k);
+      possible_roots.erase(possible_roots.begin(),
+          possible_roots.begin() + k);
     }
+  }
+}
 
-    unreachable.clear();
+void libbirch::collect_if_due() {
+  size_t nroots = 0u, nbytes = 0u;
+  for (int tid = 0; tid < get_max_threads(); ++tid) {
+    nroots += get_possible_roots(tid).size();
+    nbytes += get_heap_growth(tid).bytes;
   }
+  if (collect_bytes > 0u && nbytes >= collect_bytes) {
+    collect();
+  } else if (collect_roots > 0u && nroots >= collect_roots) {
+    if (collect_slice > 0u) {
+      collect(collect_slice);
+    } else {
+      collect();
+    }
+  }
+}
+
+void libbirch::set_collect_roots(const size_t n) {
+  collect_roots = n;
+}
+
+void libbirch::set_collect_bytes(const size_t n) {
+  collect_bytes = n;
+}
+
+void libbirch::set_collect_slice(const size_t n) {
+  collect_slice = n;
 }
 
 void libbirch::trim(Any* o) {
@@ -37,6 +37,12 @@ Label*& root();
  * @param n Number of bytes.
  *
  * @return Pointer to the allocated memory.
+ *
+ * The pooled allocator keeps unsynchronized pools for each thread, indexed
+ * by get_thread_num(). Allocation and deallocation must therefore only be
+ * called from threads of a single, non-nested, OpenMP parallel region (or
+ * outside of any), so that no two threads hold the same thread number at
+ * once. Debug builds check this.
  */
 void* allocate(const size_t n);
 
@@ -63,6 +69,105 @@ void deallocate(void* ptr, const size_t n, const int tid);
 void* reallocate(void* ptr1, const size_t n1, const int tid1,
     const size_t n2);
 
+/**
+ * Round up a number of bytes to a size for which an allocation wastes no
+ * space. For the pooled allocator, this is the size of the size class of the
+ * allocation. Larger allocations are rounded up geometrically, with four
+ * sizes per doubling, then to whole pages. This is used by containers that
+ * grow geometrically, to choose their capacity.
+ *
+ * @param n Number of bytes.
+ *
+ * @return Rounded number of bytes.
+ */
+size_t round_allocation(const size_t n);
+
+/**
+ * Print the occupancy of the pooled allocator to standard output. For each
+ * size class in use, this reports the number of chunks reserved, the number
+ * of blocks in use, and the proportion of the space in those chunks that is
+ * occupied by blocks in use.
+ *
+ * The bookkeeping of all threads is read without synchronization, so this
+ * should only be called when other threads are not allocating, such as at
+ * the end of a program.
+ */
+void print_occupancy();
+
+/**
+ * Get statistics on memory use, as a JSON string.
+ *
+ * The statistics always include, for each size class in use by the pooled
+ * allocator, the number of chunks reserved, the number of blocks in use,
+ * and the number of bytes sitting free in pools. If libbirch, and code
+ * using it, is compiled with `ENABLE_MEMORY_STATS` defined (e.g. with
+ * `CPPFLAGS=-DENABLE_MEMORY_STATS`), they further include, per size class
+ * and per thread, the number of allocations and deallocations and the bytes
+ * allocated and deallocated; the current and high-water bytes in use, both
+ * overall and per thread; and, per class of object, the number of objects
+ * created and destroyed and the bytes that they occupy. Otherwise this
+ * bookkeeping is compiled out, and costs nothing.
+ *
+ * A reallocation is counted as a deallocation followed by an allocation.
+ * For the purposes of the per-thread figures, memory is attributed to the
+ * thread that performs the operation, so that a thread that deallocates
+ * memory allocated by another thread may have negative bytes in use.
+ *
+ * The bookkeeping of all threads is read without synchronization, so this
+ * should only be called when other threads are not allocating, such as at
+ * the end of a program.
+ */
+std::string memory_stats();
+
+/**
+ * Record the creation of an object for memory statistics. This is called
+ * when the first shared pointer to the object is created, as the class of
+ * the object is not known during its construction.
+ */
+void stats_create(Any* o);
+
+/**
+ * Record the destruction of an object for memory statistics.
+ */
+void stats_destroy(Any* o);
+
+/**
+ * Enter a read-side critical region, for optimistic reads of data that
+ * writers may concurrently replace, such as the table of a Memo.
+ *
+ * The current thread announces that it is reading only by updating a
+ * counter of its own, so that concurrent readers do not contend for a
+ * shared cache line. A writer that replaces such data must call
+ * synchronize_reads() before it reclaims the old data. Critical regions
+ * must not be nested, and must not block on other threads.
+ */
+void enter_read();
+
+/**
+ * Exit a read-side critical region entered with enter_read().
+ */
+void exit_read();
+
+/**
+ * Counter of read-side critical regions entered and exited by a thread, odd
+ * while within one. Each thread updates only its own.
+ */
+struct alignas(64) read_epoch {
+  Atomic<unsigned> count;
+};
+
+/**
+ * Get the read epochs of all threads.
+ */
+read_epoch* get_read_epochs();
+
+/**
+ * Wait until all other threads that are within a read-side critical region
+ * have exited it. On return, no thread can still be reading data that was
+ * replaced before the call, and it may be reclaimed.
+ */
+void synchronize_reads();
+
 /**
  * Register an object with the cycle collector as the possible root of a
  * cycle. This corresponds to the `PossibleRoot()` operation in @ref Bacon2001
@@ -75,11 +180,124 @@ void register_possible_root(Any* o);
  */
 void register_unreachable(Any* o);
 
+/**
+ * Operations for which visits may be deferred with defer_visit().
+ */
+enum visit_op : int {
+  VISIT_FINISH,
+  VISIT_FREEZE,
+  VISIT_MARK,
+  VISIT_SCAN,
+  VISIT_REACH,
+  VISIT_COLLECT
+};
+
+/**
+ * Defer the visit to the member variables of an object, and for operations
+ * of the cycle collector its label, for an operation on the object graph.
+ *
+ * @param o The object.
+ * @param op The operation.
+ * @param label The label, for a finish operation.
+ *
+ * Deferred visits are made from an explicit stack for each thread, rather
+ * than recursively, so that the depth of the object graph, such as a long
+ * linked list, is not limited by the size of the call stack. The cycle
+ * collector makes them itself; for finish and freeze operations, the caller
+ * makes them with visit_deferred(). Idle threads may take deferred visits
+ * from others to balance the load.
+ */
+void defer_visit(Any* o, const int op, Label* label = nullptr);
+
+/**
+ * Make the deferred visits of the current thread, and any further visits
+ * that these defer, until none remain.
+ *
+ * If called outside of a parallel region and the object graph proves wide
+ * enough, this starts one, so that the visits are shared between all
+ * threads.
+ */
+void visit_deferred();
+
+/**
+ * Make the deferred visits of the current thread, and any further visits
+ * that these defer, until a given number remain.
+ *
+ * @param n Number of visits to remain.
+ *
+ * The visits are made by the current thread only. This is used where an
+ * object must hold a lock until the visits that it defers are complete,
+ * such as Label, which holds a read lock on its memo: the number of
+ * deferred visits is noted with num_deferred() before deferring further
+ * visits, then restored with this before releasing the lock.
+ */
+void visit_deferred(const size_t n);
+
+/**
+ * Number of deferred visits of the current thread.
+ */
+size_t num_deferred();
+
 /**
  * Run the cycle collector.
+ *
+ * Possible roots registered by all threads are processed by all threads,
+ * claimed in batches, and visits to further objects are shared with idle
+ * threads, so that the load is balanced regardless of which threads
+ * registered the possible roots.
  */
 void collect();
 
+/**
+ * Run the cycle collector on a slice of the registered possible roots.
+ *
+ * @param n Maximum number of possible roots to process.
+ *
+ * The oldest possible roots are processed first, taken from the list of
+ * each thread in proportion to its length. Objects reachable from these are traversed in full, so while the
+ * pause is not strictly bounded by @p n, it is bounded by the size of the
+ * object graph reachable from @p n roots, rather than from all of them.
+ * Garbage cycles not reachable from the slice remain to be collected by a
+ * later slice or full collection.
+ */
+void collect(const size_t n);
+
+/**
+ * Run the cycle collector if it is due according to the collection policy.
+ *
+ * A full collection is run if the heap has grown by at least the number of
+ * bytes set with set_collect_bytes() since the last full collection.
+ * Otherwise, a slice of the number of possible roots set with
+ * set_collect_slice() is collected if at least the number set with
+ * set_collect_roots() are registered. This is intended as a cheap call to
+ * make at regular points in a program, such as after each resampling step
+ * of a particle filter, in place of collect().
+ *
+ * The bookkeeping of all threads is read, so this should be called outside
+ * of parallel regions.
+ */
+void collect_if_due();
+
+/**
+ * Set the number of registered possible roots at which collect_if_due()
+ * collects a slice. Zero disables this trigger.
+ */
+void set_collect_roots(const size_t n);
+
+/**
+ * Set the number of bytes of heap growth at which collect_if_due() runs a
+ * full collection. Growth is measured as the size of the chunks acquired by
+ * the pooled allocator, plus the size of large allocations, since the last
+ * full collection. Zero disables this trigger.
+ */
+void set_collect_bytes(const size_t n);
+
+/**
+ * Set the maximum number of possible roots in a slice collected by
+ * collect_if_due(). Zero makes each collection a full collection.
+ */
+void set_collect_slice(const size_t n);
+
 /**
  * Performs some maintenance operations on the current thread's set of
  * registered possible roots.
@@ -96,3 +314,17 @@ void collect();
 void trim(Any* o);
 
 }
+
+inline void libbirch::enter_read() {
+  static read_epoch* epochs = get_read_epochs();
+  auto& epoch = epochs[get_thread_num()];
+  assert(epoch.count.load() % 2u == 0u);
+  epoch.count.increment();
+}
+
+inline void libbirch::exit_read() {
+  static read_epoch* epochs = get_read_epochs();
+  auto& epoch = epochs[get_thread_num()];
+  assert(epoch.count.load() % 2u == 1u);
+  epoch.count.increment();
+}
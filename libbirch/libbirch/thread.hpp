@@ -33,4 +33,17 @@ inline int get_thread_num() {
 #endif
 }
 
+/**
+ * Is the current thread within a parallel region?
+ *
+ * @ingroup libbirch
+ */
+inline bool in_parallel() {
+#ifdef _OPENMP
+  return omp_in_parallel();
+#else
+  return false;
+#endif
+}
+
 }
@@ -0,0 +1,165 @@
+/**
+ * @file
+ *
+ * Waiting primitives for the locks. By default, a thread waiting on a lock
+ * spins with exponential backoff for a short time, then parks, so that it
+ * does not occupy a core while the holder of the lock, perhaps preempted,
+ * needs it. Parking uses a futex on Linux, and otherwise yields. If
+ * libbirch, and code using it, is compiled with `DISABLE_ADAPTIVE_LOCKS`
+ * defined (e.g. with `CPPFLAGS=-DDISABLE_ADAPTIVE_LOCKS`), threads instead
+ * spin until the lock is available, which may have lower latency when every
+ * thread has a core to itself.
+ */
+#pragma once
+
+#include "libbirch/external.hpp"
+#include "libbirch/Atomic.hpp"
+
+namespace libbirch {
+/**
+ * Bit of a counter that flags that threads are parked waiting on it, for
+ * wait_zero() and decrement_wake().
+ */
+static constexpr unsigned PARKED = 1u << 31u;
+
+/**
+ * Hint to the processor that the calling thread is spinning.
+ *
+ * @ingroup libbirch
+ */
+inline void spin_pause() {
+  #if defined(__SSE2__)
+  _mm_pause();
+  #elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+  #endif
+}
+
+/**
+ * Exponential backoff for a thread spinning on a contended atomic.
+ *
+ * @ingroup libbirch
+ */
+class Backoff {
+public:
+  /**
+   * Constructor.
+   */
+  Backoff() : n(0u) {
+    //
+  }
+
+  /**
+   * Spin for the next interval, doubling the interval each time.
+   *
+   * @return False once the budget for spinning is exhausted, in which case
+   * the caller should park instead.
+   */
+  bool spin() {
+    #ifdef DISABLE_ADAPTIVE_LOCKS
+    return true;
+    #else
+    if (n < MAX) {
+      for (unsigned i = 0u; i < (1u << n); ++i) {
+        spin_pause();
+      }
+      ++n;
+      return true;
+    } else {
+      return false;
+    }
+    #endif
+  }
+
+private:
+  /**
+   * Number of intervals after which to park. The intervals total 511
+   * pauses, somewhere in tens of microseconds.
+   */
+  static constexpr unsigned MAX = 9u;
+
+  /**
+   * Number of intervals so far.
+   */
+  unsigned n;
+};
+
+/**
+ * Park the calling thread while an atomic word holds a given value. The
+ * thread may be woken spuriously, and so should check the word again on
+ * return.
+ *
+ * @ingroup libbirch
+ *
+ * @param word The word, which must be 32 bits.
+ * @param value The value.
+ */
+template<class T>
+void park(Atomic<T>& word, const T value) {
+  static_assert(sizeof(Atomic<T>) == sizeof(int), "futex must be 32 bits");
+  #ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE,
+      int(value), nullptr, nullptr, 0);
+  #else
+  sched_yield();
+  #endif
+}
+
+/**
+ * Wake all threads parked on an atomic word.
+ *
+ * @ingroup libbirch
+ *
+ * @param word The word, which must be 32 bits.
+ */
+template<class T>
+void unpark_all(Atomic<T>& word) {
+  static_assert(sizeof(Atomic<T>) == sizeof(int), "futex must be 32 bits");
+  #ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE_PRIVATE,
+      INT_MAX, nullptr, nullptr, 0);
+  #endif
+}
+
+/**
+ * Wait until a counter is zero, ignoring its PARKED bit.
+ *
+ * @ingroup libbirch
+ */
+inline void wait_zero(Atomic<unsigned>& counter) {
+  Backoff backoff;
+  unsigned c;
+  while (((c = counter.load()) & ~PARKED) != 0u) {
+    if (!backoff.spin()) {
+      /* flag that there is a thread parked, so that the thread that brings
+       * the counter to zero wakes it */
+      if ((c & PARKED) || counter.compareExchange(c, c | PARKED)) {
+        park(counter, c | PARKED);
+      }
+    }
+  }
+}
+
+/**
+ * Decrement a counter, waking any threads parked in wait_zero() if it
+ * becomes zero.
+ *
+ * @ingroup libbirch
+ *
+ * @return The new count, ignoring its PARKED bit.
+ */
+inline unsigned decrement_wake(Atomic<unsigned>& counter) {
+  auto c = --counter;
+  if (c == PARKED) {
+    /* the exchange fails if another thread has since incremented the
+     * counter, in which case it will wake parked threads instead */
+    auto expected = c;
+    while (!counter.compareExchange(expected, 0u) && expected == PARKED);
+    if (expected == PARKED) {
+      unpark_all(counter);
+    }
+  }
+  return c & ~PARKED;
+}
+
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+set -eo pipefail
+
+ls src/benchmark | grep '\.birch' | sed "s/.birch$//g" | xargs -t -L 1 birch